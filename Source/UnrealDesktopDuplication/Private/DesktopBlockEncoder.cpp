@@ -0,0 +1,472 @@
+// <copyright file="DesktopBlockEncoder.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "DesktopBlockEncoder.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <limits>
+
+#include <smmintrin.h>
+
+#include "Async/ParallelFor.h"
+
+
+namespace {
+
+    /// <summary>
+    /// Loads the four rows of a 4x4 block of BGRA pixels.
+    /// </summary>
+    inline void LoadBlock(__m128i (&rows)[4],
+            const uint8 *src,
+            const uint32 pitch) noexcept {
+        for (uint32 y = 0; y < 4; ++y) {
+            rows[y] = _mm_loadu_si128(
+                reinterpret_cast<const __m128i *>(src + y * pitch));
+        }
+    }
+
+    /// <summary>
+    /// Computes the per-channel minimum and maximum of a block.
+    /// </summary>
+    inline void GetBounds(uint8 (&lo)[4],
+            uint8 (&hi)[4],
+            const __m128i (&rows)[4]) noexcept {
+        auto mn = _mm_min_epu8(_mm_min_epu8(rows[0], rows[1]),
+            _mm_min_epu8(rows[2], rows[3]));
+        auto mx = _mm_max_epu8(_mm_max_epu8(rows[0], rows[1]),
+            _mm_max_epu8(rows[2], rows[3]));
+
+        // Reduce the four pixels in each register to one.
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(2, 3, 0, 1)));
+        mn = _mm_min_epu8(mn, _mm_shuffle_epi32(mn, _MM_SHUFFLE(1, 0, 3, 2)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(2, 3, 0, 1)));
+        mx = _mm_max_epu8(mx, _mm_shuffle_epi32(mx, _MM_SHUFFLE(1, 0, 3, 2)));
+
+        const auto l = static_cast<uint32>(_mm_cvtsi128_si32(mn));
+        const auto h = static_cast<uint32>(_mm_cvtsi128_si32(mx));
+        ::memcpy(lo, &l, sizeof(lo));
+        ::memcpy(hi, &h, sizeof(hi));
+    }
+
+    /// <summary>
+    /// Chooses the diagonal of the bounding box along which the colours of a
+    /// block are distributed.
+    /// </summary>
+    /// <remarks>
+    /// The bounding box always spans from the per-channel minimum to the
+    /// maximum, which only fits if all channels increase together. For
+    /// anti-correlated channels, like in a fade from blue to orange, the
+    /// endpoints of these channels are swapped. The correlation is measured
+    /// against the channel with the largest extent.
+    /// </remarks>
+    inline void SelectDiagonal(int32 (&lo)[4],
+            int32 (&hi)[4],
+            const __m128i (&rows)[4]) noexcept {
+        uint32 reference = 0;
+        uint32 varying = (hi[0] != lo[0]) ? 1 : 0;
+        for (uint32 c = 1; c < 3; ++c) {
+            varying += (hi[c] != lo[c]) ? 1 : 0;
+            if (hi[c] - lo[c] > hi[reference] - lo[reference]) {
+                reference = c;
+            }
+        }
+
+        // Unless at least two channels vary, both diagonals are the same,
+        // which is the case for most blocks of a desktop.
+        if (varying < 2) {
+            return;
+        }
+
+        // Compute the covariances in 32 bits, which is safe as the doubled
+        // deviations from the centre of the box fit into 16 bits. The
+        // deviation of the reference channel is broadcast to all channels of
+        // its pixel.
+        const auto centre = _mm_setr_epi16(lo[0] + hi[0], lo[1] + hi[1],
+            lo[2] + hi[2], 0, lo[0] + hi[0], lo[1] + hi[1], lo[2] + hi[2], 0);
+        const auto r0 = static_cast<char>(2 * reference);
+        const auto r1 = static_cast<char>(2 * reference + 1);
+        const auto r2 = static_cast<char>(2 * reference + 8);
+        const auto r3 = static_cast<char>(2 * reference + 9);
+        const auto broadcast = _mm_setr_epi8(r0, r1, r0, r1, r0, r1, r0, r1,
+            r2, r3, r2, r3, r2, r3, r2, r3);
+        const auto zero = _mm_setzero_si128();
+        auto sum = _mm_setzero_si128();
+
+        for (uint32 y = 0; y < 4; ++y) {
+            const __m128i pixels[] = {
+                _mm_unpacklo_epi8(rows[y], zero),
+                _mm_unpackhi_epi8(rows[y], zero)
+            };
+
+            for (auto& p : pixels) {
+                const auto d = _mm_sub_epi16(_mm_slli_epi16(p, 1), centre);
+                const auto r = _mm_shuffle_epi8(d, broadcast);
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(
+                    _mm_unpacklo_epi16(d, zero),
+                    _mm_unpacklo_epi16(r, zero)));
+                sum = _mm_add_epi32(sum, _mm_madd_epi16(
+                    _mm_unpackhi_epi16(d, zero),
+                    _mm_unpackhi_epi16(r, zero)));
+            }
+        }
+
+        int32 covariance[4];
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(covariance), sum);
+
+        for (uint32 c = 0; c < 3; ++c) {
+            if (covariance[c] < 0) {
+                std::swap(lo[c], hi[c]);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Projects all pixels of a block on the line from <paramref name="from" />
+    /// to <paramref name="to" /> and quantises the position to
+    /// [0, <paramref name="levels" />].
+    /// </summary>
+    inline void Project(int32 (&dst)[16],
+            const __m128i (&rows)[4],
+            const int32 (&from)[4],
+            const int32 (&to)[4],
+            const int32 levels) noexcept {
+        int32 axis[4];
+        int32 length = 0;
+        int32 origin = 0;
+        for (uint32 c = 0; c < 4; ++c) {
+            axis[c] = to[c] - from[c];
+            length += axis[c] * axis[c];
+            origin += axis[c] * from[c];
+        }
+
+        if (length == 0) {
+            std::fill(std::begin(dst), std::end(dst), 0);
+            return;
+        }
+
+        const auto a = _mm_setr_epi16(axis[0], axis[1], axis[2], axis[3],
+            axis[0], axis[1], axis[2], axis[3]);
+        const auto max = _mm_set1_epi32(levels);
+        const auto offset = _mm_set1_epi32(origin);
+        const auto scale = _mm_set1_ps(static_cast<float>(levels) / length);
+        const auto zero = _mm_setzero_si128();
+
+        for (uint32 y = 0; y < 4; ++y) {
+            // Compute the dot products of four pixels with the axis in 32 bits,
+            // which is safe as the channels and the axis fit into 16 bits.
+            const auto lo = _mm_madd_epi16(_mm_unpacklo_epi8(rows[y], zero), a);
+            const auto hi = _mm_madd_epi16(_mm_unpackhi_epi8(rows[y], zero), a);
+            const auto dot = _mm_sub_epi32(_mm_hadd_epi32(lo, hi), offset);
+
+            auto t = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(dot), scale));
+            t = _mm_min_epi32(_mm_max_epi32(t, zero), max);
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + 4 * y), t);
+        }
+    }
+
+    /// <summary>
+    /// Appends bits to a 128-bit BC7 block.
+    /// </summary>
+    class FBitWriter final {
+
+    public:
+
+        inline FBitWriter(void) noexcept : _bits { 0, 0 }, _position(0) { }
+
+        inline void Write(const uint32 value, const uint32 count) noexcept {
+            const auto bits = static_cast<uint64>(value) & ((1ull << count) - 1);
+            const auto word = this->_position / 64;
+            const auto shift = this->_position % 64;
+
+            this->_bits[word] |= bits << shift;
+            if (shift + count > 64) {
+                this->_bits[word + 1] |= bits >> (64 - shift);
+            }
+
+            this->_position += count;
+        }
+
+        inline void Store(uint8 *dst) const noexcept {
+            ::memcpy(dst, this->_bits, sizeof(this->_bits));
+        }
+
+    private:
+
+        uint64 _bits[2];
+        uint32 _position;
+    };
+
+    /// <summary>
+    /// Converts a BGR colour to RGB 5:6:5.
+    /// </summary>
+    inline uint16 To565(const int32 (&bgr)[4]) noexcept {
+        return static_cast<uint16>(((bgr[2] >> 3) << 11)
+            | ((bgr[1] >> 2) << 5)
+            | (bgr[0] >> 3));
+    }
+
+    /// <summary>
+    /// Expands an RGB 5:6:5 colour to BGR with eight bits per channel.
+    /// </summary>
+    inline void From565(int32 (&bgr)[4], const uint16 colour) noexcept {
+        const auto r = (colour >> 11) & 0x1F;
+        const auto g = (colour >> 5) & 0x3F;
+        const auto b = colour & 0x1F;
+        bgr[0] = (b << 3) | (b >> 2);
+        bgr[1] = (g << 2) | (g >> 4);
+        bgr[2] = (r << 3) | (r >> 2);
+        bgr[3] = 0;
+    }
+
+    /// <summary>
+    /// Quantises a BC7 mode 6 endpoint to seven bits per channel and a shared
+    /// p-bit, choosing the p-bit with the lower error.
+    /// </summary>
+    inline uint32 QuantiseEndpoint(int32 (&quantised)[4],
+            int32 (&reconstructed)[4],
+            const int32 (&endpoint)[4]) noexcept {
+        int32 best = (std::numeric_limits<int32>::max)();
+        uint32 retval = 0;
+
+        for (uint32 p = 0; p < 2; ++p) {
+            int32 q[4];
+            int32 error = 0;
+            for (uint32 c = 0; c < 4; ++c) {
+                q[c] = (std::clamp)((endpoint[c] - static_cast<int32>(p) + 1) >> 1,
+                    0, 127);
+                const auto d = ((q[c] << 1) | static_cast<int32>(p)) - endpoint[c];
+                error += d * d;
+            }
+
+            if (error < best) {
+                best = error;
+                retval = p;
+                for (uint32 c = 0; c < 4; ++c) {
+                    quantised[c] = q[c];
+                    reconstructed[c] = (q[c] << 1) | static_cast<int32>(p);
+                }
+            }
+        }
+
+        return retval;
+    }
+
+} /* namespace */
+
+
+/*
+ * FDesktopBlockEncoder::GetBlockSize
+ */
+uint32 FDesktopBlockEncoder::GetBlockSize(
+        const EDesktopBlockCompression compression) noexcept {
+    switch (compression) {
+        case EDesktopBlockCompression::BC1:
+            return 8;
+
+        case EDesktopBlockCompression::BC7:
+            return 16;
+
+        default:
+            return 0;
+    }
+}
+
+
+/*
+ * FDesktopBlockEncoder::GetPixelFormat
+ */
+EPixelFormat FDesktopBlockEncoder::GetPixelFormat(
+        const EDesktopBlockCompression compression) noexcept {
+    switch (compression) {
+        case EDesktopBlockCompression::BC1:
+            return EPixelFormat::PF_DXT1;
+
+        case EDesktopBlockCompression::BC7:
+            return EPixelFormat::PF_BC7;
+
+        default:
+            return EPixelFormat::PF_B8G8R8A8;
+    }
+}
+
+
+/*
+ * FDesktopBlockEncoder::Encode
+ */
+void FDesktopBlockEncoder::Encode(uint8 *dst,
+        const uint32 dstPitch,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height,
+        const FIntRect& region,
+        const EDesktopBlockCompression compression) noexcept {
+    const auto blockSize = GetBlockSize(compression);
+    if ((blockSize == 0) || (width == 0) || (height == 0)) {
+        return;
+    }
+
+    const auto left = static_cast<uint32>((std::max)(region.Min.X, 0)) / 4;
+    const auto top = static_cast<uint32>((std::max)(region.Min.Y, 0)) / 4;
+    const auto right = (std::min)(
+        static_cast<uint32>((std::max)(region.Max.X, 0)), width);
+    const auto bottom = (std::min)(
+        static_cast<uint32>((std::max)(region.Max.Y, 0)), height);
+    const auto columns = (right + 3) / 4;
+    const auto rows = (bottom + 3) / 4;
+
+    if ((left >= columns) || (top >= rows)) {
+        return;
+    }
+
+    const auto encode = (compression == EDesktopBlockCompression::BC1)
+        ? &FDesktopBlockEncoder::EncodeBC1
+        : &FDesktopBlockEncoder::EncodeBC7;
+
+    ParallelFor(rows - top, [&](const int32 i) {
+        const auto y = top + i;
+        uint8 border[4 * 4 * 4];
+
+        for (auto x = left; x < columns; ++x) {
+            auto s = src + 4 * y * srcPitch + 4 * 4 * x;
+            auto p = srcPitch;
+
+            if ((4 * x + 4 > width) || (4 * y + 4 > height)) {
+                // Blocks crossing the border of the image are padded by
+                // replicating the last valid row and column.
+                for (uint32 by = 0; by < 4; ++by) {
+                    const auto sy = (std::min)(4 * y + by, height - 1);
+                    for (uint32 bx = 0; bx < 4; ++bx) {
+                        const auto sx = (std::min)(4 * x + bx, width - 1);
+                        ::memcpy(border + 4 * (4 * by + bx),
+                            src + sy * srcPitch + 4 * sx,
+                            4);
+                    }
+                }
+
+                s = border;
+                p = 4 * 4;
+            }
+
+            encode(dst + y * dstPitch + x * blockSize, s, p);
+        }
+    });
+}
+
+
+/*
+ * FDesktopBlockEncoder::EncodeBC1
+ */
+void FDesktopBlockEncoder::EncodeBC1(uint8 *dst,
+        const uint8 *src,
+        const uint32 pitch) noexcept {
+    __m128i rows[4];
+    LoadBlock(rows, src, pitch);
+
+    uint8 lo[4], hi[4];
+    GetBounds(lo, hi, rows);
+
+    // Inset the bounding box by 1/16 of its extent, which reduces the error
+    // of the interpolated colours.
+    int32 mn[4] = { 0, 0, 0, 0 };
+    int32 mx[4] = { 0, 0, 0, 0 };
+    for (uint32 c = 0; c < 3; ++c) {
+        const auto inset = (hi[c] - lo[c]) >> 4;
+        mn[c] = lo[c] + inset;
+        mx[c] = hi[c] - inset;
+    }
+
+    SelectDiagonal(mn, mx, rows);
+
+    // If 'c0' is less than 'c1', the block would be decoded in 3-colour mode,
+    // so we swap the endpoints in this case.
+    auto c0 = To565(mx);
+    auto c1 = To565(mn);
+    if (c0 < c1) {
+        std::swap(c0, c1);
+    }
+    uint32 indices = 0;
+
+    if (c0 != c1) {
+        // Project on the quantised endpoints, because these are what the
+        // GPU interpolates between.
+        int32 e0[4], e1[4];
+        From565(e0, c0);
+        From565(e1, c1);
+
+        // Map the position on the line from 'c1' to 'c0' to the BC1 order,
+        // which is c0, c1, 2/3 c0 + 1/3 c1 and 1/3 c0 + 2/3 c1.
+        static constexpr uint32 Order[] = { 1, 3, 2, 0 };
+        int32 t[16];
+        Project(t, rows, e1, e0, 3);
+        for (uint32 i = 0; i < 16; ++i) {
+            indices |= Order[t[i]] << (2 * i);
+        }
+    }
+
+    ::memcpy(dst, &c0, sizeof(c0));
+    ::memcpy(dst + 2, &c1, sizeof(c1));
+    ::memcpy(dst + 4, &indices, sizeof(indices));
+}
+
+
+/*
+ * FDesktopBlockEncoder::EncodeBC7
+ */
+void FDesktopBlockEncoder::EncodeBC7(uint8 *dst,
+        const uint8 *src,
+        const uint32 pitch) noexcept {
+    __m128i rows[4];
+    LoadBlock(rows, src, pitch);
+
+    uint8 lo[4], hi[4];
+    GetBounds(lo, hi, rows);
+
+    int32 mn[4], mx[4];
+    for (uint32 c = 0; c < 4; ++c) {
+        mn[c] = lo[c];
+        mx[c] = hi[c];
+    }
+    SelectDiagonal(mn, mx, rows);
+
+    int32 q0[4], q1[4];
+    int32 e0[4], e1[4];
+    auto p0 = QuantiseEndpoint(q0, e0, mn);
+    auto p1 = QuantiseEndpoint(q1, e1, mx);
+
+    int32 indices[16];
+    Project(indices, rows, e0, e1, 15);
+
+    // The most significant bit of the first index is implicitly zero, so we
+    // need to swap the endpoints if this is not the case.
+    if (indices[0] > 7) {
+        std::swap(q0, q1);
+        std::swap(p0, p1);
+        for (auto& i : indices) {
+            i = 15 - i;
+        }
+    }
+
+    // Mode 6 stores the endpoints as RGBA whereas the pixels are BGRA.
+    static constexpr uint32 Channels[] = { 2, 1, 0, 3 };
+
+    FBitWriter writer;
+    writer.Write(1 << 6, 7);
+    for (auto c : Channels) {
+        writer.Write(q0[c], 7);
+        writer.Write(q1[c], 7);
+    }
+    writer.Write(p0, 1);
+    writer.Write(p1, 1);
+    writer.Write(indices[0], 3);
+    for (uint32 i = 1; i < 16; ++i) {
+        writer.Write(indices[i], 4);
+    }
+
+    writer.Store(dst);
+}
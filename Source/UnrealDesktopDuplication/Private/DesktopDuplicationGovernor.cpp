@@ -0,0 +1,178 @@
+// <copyright file="DesktopDuplicationGovernor.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "DesktopDuplicationGovernor.h"
+
+#include <algorithm>
+
+
+/*
+ * FDesktopDuplicationGovernor::FDesktopDuplicationGovernor
+ */
+FDesktopDuplicationGovernor::FDesktopDuplicationGovernor(const float budget,
+        const int32 degradeAfter,
+        const int32 recoverAfter,
+        const float headroom) noexcept
+    : _average(0.0f),
+    _budget(budget),
+    _countdown(0),
+    _degradeAfter((std::max)(degradeAfter, 1)),
+    _headroom(headroom),
+    _level(EDesktopDuplicationLoad::Unrestricted),
+    _over(0),
+    _recoverAfter((std::max)(recoverAfter, 1)),
+    _under(0) { }
+
+
+/*
+ * FDesktopDuplicationGovernor::GetFrameInterval
+ */
+int32 FDesktopDuplicationGovernor::GetFrameInterval(void) const noexcept {
+    return GetFrameInterval(this->_level);
+}
+
+
+/*
+ * FDesktopDuplicationGovernor::GetFrameInterval
+ */
+int32 FDesktopDuplicationGovernor::GetFrameInterval(
+        const EDesktopDuplicationLoad level) noexcept {
+    switch (level) {
+        case EDesktopDuplicationLoad::ReducedRate:
+            return 2;
+
+        case EDesktopDuplicationLoad::CoarseUpdates:
+        case EDesktopDuplicationLoad::HalfResolution:
+            return 4;
+
+        default:
+            return 1;
+    }
+}
+
+
+/*
+ * FDesktopDuplicationGovernor::Pressure
+ */
+void FDesktopDuplicationGovernor::Pressure(void) noexcept {
+    this->_under = 0;
+    if ((++this->_over >= this->_degradeAfter)
+            && (this->_level != EDesktopDuplicationLoad::HalfResolution)) {
+        // Project the history on the new level, because it would otherwise
+        // take the average a while to register the relief.
+        const auto interval = this->GetFrameInterval();
+        this->_level = static_cast<EDesktopDuplicationLoad>(
+            static_cast<uint8>(this->_level) + 1);
+        this->_average *= static_cast<float>(interval)
+            / this->GetFrameInterval();
+        this->_over = 0;
+    }
+}
+
+
+/*
+ * FDesktopDuplicationGovernor::Reset
+ */
+void FDesktopDuplicationGovernor::Reset(void) noexcept {
+    this->_average = 0.0f;
+    this->_countdown = 0;
+    this->_level = EDesktopDuplicationLoad::Unrestricted;
+    this->_over = 0;
+    this->_under = 0;
+}
+
+
+/*
+ * FDesktopDuplicationGovernor::SetBudget
+ */
+void FDesktopDuplicationGovernor::SetBudget(const float budget) noexcept {
+    if (this->_budget != budget) {
+        this->_budget = budget;
+        this->Reset();
+    }
+}
+
+
+/*
+ * FDesktopDuplicationGovernor::ShouldCapture
+ */
+bool FDesktopDuplicationGovernor::ShouldCapture(void) noexcept {
+    if (this->_countdown > 0) {
+        --this->_countdown;
+        return false;
+    }
+
+    this->_countdown = this->GetFrameInterval() - 1;
+    return true;
+}
+
+
+/*
+ * FDesktopDuplicationGovernor::Stall
+ */
+EDesktopDuplicationLoad FDesktopDuplicationGovernor::Stall(void) noexcept {
+    // A stall does not tell us how long the frame in flight actually takes,
+    // so we do not touch the average, but only count it as pressure.
+    if (this->_budget <= 0.0f) {
+        return this->_level;
+    }
+
+    this->Pressure();
+    return this->_level;
+}
+
+
+/*
+ * FDesktopDuplicationGovernor::Update
+ */
+EDesktopDuplicationLoad FDesktopDuplicationGovernor::Update(
+        const float frameTime) noexcept {
+    if (this->_budget <= 0.0f) {
+        return this->_level;
+    }
+
+    // The cost of a captured frame is spread over the skipped ones, because
+    // otherwise, reducing the rate would never register as relief.
+    const auto interval = this->GetFrameInterval();
+    const auto sample = frameTime / interval;
+
+    // Smooth the samples such that a single hiccup does not change the level.
+    if (this->_average <= 0.0f) {
+        this->_average = sample;
+    } else {
+        this->_average += Smoothing * (sample - this->_average);
+    }
+
+    // Recovering is only safe if the less restricted level, which skips
+    // fewer frames, would still be within the headroom.
+    auto projected = this->_average;
+    if (this->_level != EDesktopDuplicationLoad::Unrestricted) {
+        const auto next = static_cast<EDesktopDuplicationLoad>(
+            static_cast<uint8>(this->_level) - 1);
+        projected *= static_cast<float>(interval) / GetFrameInterval(next);
+    }
+
+    if (this->_average > this->_budget) {
+        this->Pressure();
+
+    } else if (projected < this->_headroom * this->_budget) {
+        this->_over = 0;
+        if ((++this->_under >= this->_recoverAfter)
+                && (this->_level != EDesktopDuplicationLoad::Unrestricted)) {
+            this->_level = static_cast<EDesktopDuplicationLoad>(
+                static_cast<uint8>(this->_level) - 1);
+            this->_average = projected;
+            this->_under = 0;
+        }
+
+    } else {
+        // Within the hysteresis band, we keep the current level.
+        this->_over = 0;
+        this->_under = 0;
+    }
+
+    return this->_level;
+}
@@ -8,6 +8,7 @@
 
 #include <cassert>
 #include <regex>
+#include <vector>
 
 #include "Windows/AllowWindowsPlatformTypes.h"
 #include <Windows.h>
@@ -16,12 +17,23 @@
 #include <dxgi1_2.h>
 #include "Windows/HideWindowsPlatformTypes.h"
 
+#include "Async/Async.h"
+#include "Async/ParallelFor.h"
+
+#include "HAL/PlatformTime.h"
+
 #include "Misc/ScopeExit.h"
 
 #include "Runtime/RHI/Public/RHI.h"
 
+#include "UObject/UObjectIterator.h"
+
 #include "ID3D11DynamicRHI.h"
 
+#include "DesktopBlockEncoder.h"
+#include "DesktopImageKernels.h"
+#include "DesktopYuvConverter.h"
+
 
 // TODO: find out how this is done correctly ...
 #pragma comment(lib, "d3d11.lib")
@@ -33,17 +45,101 @@
 DEFINE_LOG_CATEGORY(DesktopDuplicatorLog);
 
 
+/// <summary>
+/// Holds the objects required for duplicating an output before they are
+/// attached to a <see cref="UDesktopDuplicator"/>.
+/// </summary>
+struct FDesktopDuplicationSession final {
+    ID3D11DeviceContext *Context = nullptr;
+    ID3D11Device *Device = nullptr;
+    IDXGIOutputDuplication *Duplication = nullptr;
+    int32 Rotation = 0;
+
+    /// <summary>
+    /// Retrieves the immediate context of the <see cref="Device"/>.
+    /// </summary>
+    void OpenContext(void) noexcept {
+        assert(this->Device != nullptr);
+        assert(this->Context == nullptr);
+        this->Device->GetImmediateContext(&this->Context);
+        assert(this->Context != nullptr);
+
+        // Frames may be coalesced on the game thread while the render thread
+        // is using the context, so we need to serialise the calls.
+        ID3D11Multithread *multithread = nullptr;
+        auto hr = this->Context->QueryInterface(&multithread);
+        if (SUCCEEDED(hr)) {
+            multithread->SetMultithreadProtected(TRUE);
+            multithread->Release();
+        }
+    }
+
+    /// <summary>
+    /// Derives the <see cref="Rotation"/> from the
+    /// <see cref="Duplication"/>.
+    /// </summary>
+    void ReadRotation(void) noexcept {
+        assert(this->Duplication != nullptr);
+        // The duplicated surface is not rotated, but the desktop should look
+        // like on the physical display.
+        DXGI_OUTDUPL_DESC desc;
+        this->Duplication->GetDesc(&desc);
+        this->Rotation = (desc.Rotation > DXGI_MODE_ROTATION_IDENTITY)
+            ? desc.Rotation - DXGI_MODE_ROTATION_IDENTITY
+            : 0;
+    }
+
+    /// <summary>
+    /// Releases all objects that have not been attached.
+    /// </summary>
+    void Release(void) noexcept {
+        if (this->Context != nullptr) {
+            this->Context->Release();
+            this->Context = nullptr;
+        }
+        if (this->Device != nullptr) {
+            this->Device->Release();
+            this->Device = nullptr;
+        }
+        if (this->Duplication != nullptr) {
+            this->Duplication->Release();
+            this->Duplication = nullptr;
+        }
+    }
+};
+
+
 /*
  * UDesktopDuplicator::UDesktopDuplicator
  */
 UDesktopDuplicator::UDesktopDuplicator(void)
     : AllowGpuCopy(false),
+    CompressedTarget(nullptr),
+    Compression(EDesktopBlockCompression::None),
+    FocusRadius(256),
+    FollowPointer(true),
+    FrameBudget(0.0f),
+    IdleTimeout(0.0f),
+    MaxUpdateLatency(8),
+    PeripheralInterval(1),
+    YuvFormat(EDesktopYuvFormat::None),
+    YuvFullRange(false),
+    _bufferSize(0),
+    _coalesced(nullptr),
+    _compression(EDesktopBlockCompression::None),
     _context(nullptr),
     _device(nullptr),
     _duplication(nullptr),
     _fence(nullptr),
+    _lastUpdate(0.0),
+    _pointer(0, 0),
+    _pointerVisible(false),
+    _renderTime(0.0f),
+    _rotation(0),
     _stagingProjection(nullptr),
-    _stagingTexture(nullptr) { }
+    _stagingTexture(nullptr),
+    _yuvFormat(EDesktopYuvFormat::None),
+    _yuvFullRange(false) { }
 
 
 /*
@@ -51,12 +147,32 @@ UDesktopDuplicator::UDesktopDuplicator(void)
  */
 UDesktopDuplicator::UDesktopDuplicator(const FObjectInitializer& initialiser)
     : Super(initialiser),
+    CompressedTarget(nullptr),
+    Compression(EDesktopBlockCompression::None),
+    FocusRadius(256),
+    FollowPointer(true),
+    FrameBudget(0.0f),
+    IdleTimeout(0.0f),
+    MaxUpdateLatency(8),
+    PeripheralInterval(1),
+    YuvFormat(EDesktopYuvFormat::None),
+    YuvFullRange(false),
+    _bufferSize(0),
+    _coalesced(nullptr),
+    _compression(EDesktopBlockCompression::None),
     _context(nullptr),
     _device(nullptr),
     _duplication(nullptr),
     _fence(nullptr),
+    _lastUpdate(0.0),
+    _pointer(0, 0),
+    _pointerVisible(false),
+    _renderTime(0.0f),
+    _rotation(0),
     _stagingProjection(nullptr),
-    _stagingTexture(nullptr) { }
+    _stagingTexture(nullptr),
+    _yuvFormat(EDesktopYuvFormat::None),
+    _yuvFullRange(false) { }
 
 
 /*
@@ -81,71 +197,278 @@ bool UDesktopDuplicator::Acquire(const int32 timeout) noexcept {
         return false;
     }
 
-    if (this->Target == nullptr) {
+    if ((this->Target == nullptr)
+            && (this->Compression == EDesktopBlockCompression::None)) {
         UE_LOG(DesktopDuplicatorLog,
             Error,
             TEXT("No duplication target has been set."));
         return false;
     }
 
+    this->_governor.SetBudget(this->FrameBudget);
+    if (!this->_governor.ShouldCapture()) {
+        UE_LOG(DesktopDuplicatorLog,
+            Verbose,
+            TEXT("Skipping desktop duplication frame to stay within the ")
+            TEXT("frame budget."));
+        return false;
+    }
+
     if (this->_busy.AtomicSet(true)) {
         UE_LOG(DesktopDuplicatorLog,
             Display,
             TEXT("Previous duplication frame is still being processed."));
+        this->_governor.Stall();
+        this->Coalesce();
         return false;
     }
 
-    DXGI_OUTDUPL_FRAME_INFO info { };
+    // If the render thread failed to upload anything, it handed the regions
+    // back along with the busy flag.
+    for (auto& r : this->_failed) {
+        this->_scheduler.MarkDirty(r);
+    }
+    this->_failed.Reset();
+
     IDXGIResource *resource = nullptr;
+    double start = 0.0;
 
-    {
+    if (this->_coalesced != nullptr) {
+        // A frame has been coalesced while the render thread was busy. Its
+        // regions are already in the scheduler, but its content is not in the
+        // staging texture yet, so we must stage it before acquiring another
+        // one.
         UE_LOG(DesktopDuplicatorLog,
             Display,
-            TEXT("Releasing previously acquired desktop."));
-        auto hr = this->_duplication->ReleaseFrame();
-        if (FAILED(hr)) {
+            TEXT("Staging previously coalesced desktop."));
+        start = FPlatformTime::Seconds();
+        resource = this->_coalesced;
+        this->_coalesced = nullptr;
+
+    } else {
+        DXGI_OUTDUPL_FRAME_INFO info { };
+
+        {
             UE_LOG(DesktopDuplicatorLog,
-                Warning,
-                TEXT("Releasing the previous desktop duplication frame ")
-                TEXT("failed with error 0x%x. Error 0x%x is expected for the ")
-                TEXT("first frame and if the previous acquisition timed out."),
-                hr, DXGI_ERROR_INVALID_CALL);
+                Display,
+                TEXT("Releasing previously acquired desktop."));
+            auto hr = this->_duplication->ReleaseFrame();
+            if (FAILED(hr)) {
+                UE_LOG(DesktopDuplicatorLog,
+                    Warning,
+                    TEXT("Releasing the previous desktop duplication frame ")
+                    TEXT("failed with error 0x%x. Error 0x%x is expected for ")
+                    TEXT("the first frame and if the previous acquisition ")
+                    TEXT("timed out or was coalesced."),
+                    hr, DXGI_ERROR_INVALID_CALL);
+            }
+        }
+
+        // Waiting indefinitely would hold back the deferred tiles until the
+        // desktop changes again.
+        const auto wait = ((timeout < 0) && this->_scheduler.HasPending())
+            ? 0
+            : timeout;
+
+        UE_LOG(DesktopDuplicatorLog,
+            Display,
+            TEXT("Acquire the next desktop with %d ms timeout."), wait);
+        auto hr = this->_duplication->AcquireNextFrame(wait, &info,
+            &resource);
+        switch (hr) {
+            case DXGI_ERROR_WAIT_TIMEOUT:
+                UE_LOG(DesktopDuplicatorLog,
+                    Display,
+                    TEXT("No frame available within %d ms."), wait);
+                if (this->_stagingTexture != nullptr) {
+                    // The load level or the compression might have changed
+                    // since the last frame. The staging texture still holds
+                    // the whole desktop, so the target can follow right away
+                    // as the scheduler is invalidated in this case.
+                    this->MatchTargets(this->_stagingTexture);
+                }
+                if (this->_scheduler.HasPending()) {
+                    // Deferred tiles must converge even if the desktop does
+                    // not change anymore.
+                    return this->Submit();
+                }
+                this->TrimIdle();
+                this->_busy.AtomicSet(false);
+                return false;
+
+            case DXGI_ERROR_ACCESS_LOST:
+                UE_LOG(DesktopDuplicatorLog,
+                    Warning,
+                    TEXT("Access to the desktop duplication was lost. ")
+                    TEXT("Restarting the duplicator."));
+                this->Stop();
+                this->Start();
+                this->_busy.AtomicSet(false);
+                return false;
+
+            case S_OK:
+                // Only the time spent on processing the frame counts against
+                // the budget, not the time spent on waiting for it.
+                start = FPlatformTime::Seconds();
+                ++this->_statistics.AcquiredFrames;
+
+                if (info.LastMouseUpdateTime.QuadPart != 0) {
+                    this->_pointer = FIntPoint(
+                        info.PointerPosition.Position.x,
+                        info.PointerPosition.Position.y);
+                    this->_pointerVisible = (info.PointerPosition.Visible
+                        != FALSE);
+                }
+
+                if (info.AccumulatedFrames != 0) {
+                    this->_lastUpdate = FPlatformTime::Seconds();
+
+                } else if (this->TrimIdle()
+                        || (this->_stagingTexture == nullptr)) {
+                    // Only the pointer has changed, so there is no need to
+                    // re-create the staging resources before the desktop
+                    // does.
+                    resource->Release();
+                    this->_busy.AtomicSet(false);
+                    return false;
+                }
+
+                if (info.LastPresentTime.QuadPart != 0) {
+                    this->CollectDirtyRegions(info.TotalMetadataBufferSize);
+                }
+                break;
+
+            default:
+                UE_LOG(DesktopDuplicatorLog,
+                    Error,
+                    TEXT("Acquiring next frame failed with unexpected error ")
+                    TEXT("0x%x."), hr);
+                this->_busy.AtomicSet(false);
+                return false;
         }
     }
 
-    UE_LOG(DesktopDuplicatorLog,
-        Display,
-        TEXT("Acquire the next desktop with %d ms timeout."), timeout);
-    auto hr = this->_duplication->AcquireNextFrame(timeout, &info, &resource);
-    switch (hr) {
-        case DXGI_ERROR_WAIT_TIMEOUT:
+    const auto retval = this->Stage(resource);
+
+    if (retval) {
+        // The render thread reports the time of the last frame it processed,
+        // which is good enough as we are only interested in the trend.
+        const auto gameTime = static_cast<float>(
+            1000.0 * (FPlatformTime::Seconds() - start));
+        const auto load = this->_governor.GetLevel();
+        if (this->_governor.Update(gameTime + this->_renderTime) != load) {
             UE_LOG(DesktopDuplicatorLog,
                 Display,
-                TEXT("No frame available within %d ms."), timeout);
-            this->_busy.AtomicSet(false);
-            return false;
+                TEXT("Desktop duplication load level changed to %d at an ")
+                TEXT("average cost of %f ms per frame."),
+                static_cast<int32>(this->_governor.GetLevel()),
+                this->_governor.GetAverage());
+        }
+    }
 
-        case DXGI_ERROR_ACCESS_LOST:
-            UE_LOG(DesktopDuplicatorLog,
-                Warning,
-                TEXT("Access to the desktop duplication was lost. Restarting ")
-                TEXT("the duplicator."));
-            this->Stop();
-            this->Start();
-            this->_busy.AtomicSet(false);
-            return false;
+    return retval;
+}
 
-        case S_OK:
-            return this->Stage(resource);
 
-        default:
-            UE_LOG(DesktopDuplicatorLog,
-                Error,
-                TEXT("Acquiring next frame failed with unexpected error 0x%x."),
-                hr);
-            this->_busy.AtomicSet(false);
-            return false;
+/*
+ * UDesktopDuplicator::Attach
+ */
+bool UDesktopDuplicator::Attach(IDXGIOutputDuplication *duplication,
+        ID3D11Device *device) noexcept {
+    assert(IsInGameThread());
+    if ((duplication == nullptr) || (device == nullptr)) {
+        UE_LOG(DesktopDuplicatorLog,
+            Error,
+            TEXT("Attaching a desktop duplication requires the duplication ")
+            TEXT("and the device it has been created on."));
+        return false;
+    }
+
+    // The session owns the objects it holds, so we need our own references.
+    FDesktopDuplicationSession session;
+    session.Device = device;
+    session.Device->AddRef();
+    session.Duplication = duplication;
+    session.Duplication->AddRef();
+    session.OpenContext();
+    session.ReadRotation();
+
+    return this->Attach(session);
+}
+
+
+/*
+ * UDesktopDuplicator::GetAllocatedSize
+ */
+int64 UDesktopDuplicator::GetAllocatedSize(void) const noexcept {
+    // The buffers of the render thread must not be inspected here, because
+    // they might be resized at the same time, so the render thread publishes
+    // their size once it is done with them.
+    int64 retval = this->_bufferSize
+        + this->_metadata.GetAllocatedSize()
+        + this->_regions.GetAllocatedSize()
+        + this->_yuv.GetAllocatedSize();
+
+    // The projection is an alias of the staging texture on the engine's
+    // device, which does not allocate any additional memory.
+    if (this->_stagingTexture != nullptr) {
+        D3D11_TEXTURE2D_DESC desc;
+        this->_stagingTexture->GetDesc(&desc);
+        retval += 4 * static_cast<int64>(desc.Width) * desc.Height;
     }
+
+    return retval;
+}
+
+
+/*
+ * UDesktopDuplicator::GetLoad
+ */
+EDesktopDuplicationLoad UDesktopDuplicator::GetLoad(void) const noexcept {
+    return this->_governor.GetLevel();
+}
+
+
+/*
+ * UDesktopDuplicator::GetResourceSizeEx
+ */
+void UDesktopDuplicator::GetResourceSizeEx(
+        FResourceSizeEx& cumulativeResourceSize) {
+    Super::GetResourceSizeEx(cumulativeResourceSize);
+    cumulativeResourceSize.AddDedicatedSystemMemoryBytes(
+        this->GetAllocatedSize());
+}
+
+
+/*
+ * UDesktopDuplicator::GetStatistics
+ */
+FDesktopDuplicationStatistics UDesktopDuplicator::GetStatistics(
+        void) const noexcept {
+    return this->_statistics;
+}
+
+
+/*
+ * UDesktopDuplicator::GetTotalAllocatedSize
+ */
+int64 UDesktopDuplicator::GetTotalAllocatedSize(void) noexcept {
+    int64 retval = 0;
+
+    for (TObjectIterator<UDesktopDuplicator> it; it; ++it) {
+        retval += it->GetAllocatedSize();
+    }
+
+    return retval;
+}
+
+
+/*
+ * UDesktopDuplicator::ReadYuvFrame
+ */
+bool UDesktopDuplicator::ReadYuvFrame(
+        TFunctionRef<void(const FDesktopYuvFrame&)> reader) const {
+    return this->_yuv.Read(reader);
 }
 
 
@@ -154,6 +477,7 @@ bool UDesktopDuplicator::Acquire(const int32 timeout) noexcept {
  */
 bool UDesktopDuplicator::Start(void) {
     assert(IsInGameThread());
+    const auto start = FPlatformTime::Seconds();
 
     if (this->_duplication != nullptr) {
         UE_LOG(DesktopDuplicatorLog,
@@ -162,70 +486,105 @@ bool UDesktopDuplicator::Start(void) {
         return false;
     }
 
-    auto output = this->GetOutputForDisplayName(this->DisplayName);
-    if (output == nullptr) {
-        return false;
+    FDesktopDuplicationSession session;
+    auto output = GetOutputsForDisplayNames(
+        MakeArrayView(&this->DisplayName, 1))[0];
+    if (output != nullptr) {
+        Open(session, output, this->DisplayName);
+        output->Release();
     }
 
-    // Create the device that is used for duplication. In theory, we should be
-    // able to use the one created by Unreal Engine if the RHI is D3D11, but
-    // this is extremely unstable.
-    assert(this->_device == nullptr);
-    this->_device = this->CreateDevice();
-    assert(this->_device != nullptr);
-
-    if (this->_device != nullptr) {
-        assert(this->_context == nullptr);
-        this->_device->GetImmediateContext(&this->_context);
-        assert(this->_context != nullptr);
-    }
+    const auto retval = this->Attach(session);
+    UE_LOG(DesktopDuplicatorLog,
+        Display,
+        TEXT("Starting the duplication of \"%s\" blocked the game thread ")
+        TEXT("for %f ms."), *this->DisplayName,
+        1000.0 * (FPlatformTime::Seconds() - start));
+    return retval;
+}
 
-    //ID3D11Device5 *device5 = nullptr;
-    //ON_SCOPE_EXIT{ if (device5 != nullptr) { device5->Release(); } };
-
-    //{
-    //    auto hr = this->_device->QueryInterface(::IID_ID3D11Device5,
-    //        reinterpret_cast<void **>(&device5));
-    //    if (FAILED(hr)) {
-    //        UE_LOG(DesktopDuplicatorLog,
-    //            Error,
-    //            TEXT("Failed to obtain a ID3D11Device5, which is ")
-    //            TEXT("required for creating a fence: 0x%x"), hr);
-    //        assert(device5 == nullptr);
-    //        this->_device->Release();
-    //        this->_device = nullptr;
-    //    }
-    //}
-
-    //if (device5 != nullptr) {
-    //    auto hr = device5->CreateFence(0,
-    //        D3D11_FENCE_FLAG_NONE,
-    //        ::IID_ID3D11Fence,
-    //        reinterpret_cast<void **>(&this->_fence));
-    //    if (FAILED(hr)) {
-    //        UE_LOG(DesktopDuplicatorLog,
-    //            Error,
-    //            TEXT("Creating a fence for synchronisation of ")
-    //            TEXT("desktop duplication failed with error 0x%x."),
-    //            hr);
-    //        assert(this->_fence == nullptr);
-    //        this->_device->Release();
-    //        this->_device = nullptr;
-    //    }
-    //} /* if (device5 != nullptr) */
 
-    if (this->_device != nullptr) {
-        auto hr = output->DuplicateOutput(this->_device, &this->_duplication);
-        if (FAILED(hr)) {
-            UE_LOG(DesktopDuplicatorLog,
-                Error,
-                TEXT("Duplicating output \"%s\" failed with with error 0x%x."),
-                *this->DisplayName, hr);
-            assert(this->_duplication == nullptr);
+/*
+ * UDesktopDuplicator::StartAsync
+ */
+void UDesktopDuplicator::StartAsync(
+        const TArray<UDesktopDuplicator *>& duplicators,
+        TFunction<void(const TArray<bool>&)> onCompleted) {
+    assert(IsInGameThread());
+    const auto start = FPlatformTime::Seconds();
+
+    // Collect everything the background threads need such that they never
+    // touch the duplicators themselves.
+    TArray<int32> indices;
+    TArray<FString> names;
+    TArray<TWeakObjectPtr<UDesktopDuplicator>> targets;
+    for (int32 i = 0; i < duplicators.Num(); ++i) {
+        if (duplicators[i] != nullptr) {
+            indices.Add(i);
+            names.Add(duplicators[i]->DisplayName);
+            targets.Add(duplicators[i]);
         }
     }
 
-    return (this->_duplication != nullptr);
+    const auto count = duplicators.Num();
+    const auto dispatched = FPlatformTime::Seconds();
+
+    Async(EAsyncExecution::ThreadPool,
+            [count, start, dispatched,
+            indices = MoveTemp(indices),
+            names = MoveTemp(names),
+            targets = MoveTemp(targets),
+            onCompleted = MoveTemp(onCompleted)](void) mutable {
+        // All duplicators share a single enumeration of the outputs. The
+        // devices are created in parallel, because this is what takes most
+        // of the time.
+        auto outputs = GetOutputsForDisplayNames(names);
+        TArray<FDesktopDuplicationSession> sessions;
+        sessions.SetNum(outputs.Num());
+
+        ParallelFor(outputs.Num(), [&](const int32 i) {
+            if (outputs[i] != nullptr) {
+                Open(sessions[i], outputs[i], names[i]);
+                outputs[i]->Release();
+            }
+        });
+
+        AsyncTask(ENamedThreads::GameThread,
+                [count, start, dispatched,
+                indices = MoveTemp(indices),
+                sessions = MoveTemp(sessions),
+                targets = MoveTemp(targets),
+                onCompleted = MoveTemp(onCompleted)](void) mutable {
+            const auto attaching = FPlatformTime::Seconds();
+            TArray<bool> retval;
+            retval.SetNumZeroed(count);
+            int32 started = 0;
+
+            for (int32 i = 0; i < sessions.Num(); ++i) {
+                auto duplicator = targets[i].Get();
+                if (duplicator == nullptr) {
+                    sessions[i].Release();
+                } else if (duplicator->Attach(sessions[i])) {
+                    retval[indices[i]] = true;
+                    ++started;
+                }
+            }
+
+            const auto end = FPlatformTime::Seconds();
+            UE_LOG(DesktopDuplicatorLog,
+                Display,
+                TEXT("Started %d of %d desktop duplicators in %f ms, which ")
+                TEXT("blocked the game thread for %f ms."),
+                started,
+                count,
+                1000.0 * (end - start),
+                1000.0 * ((dispatched - start) + (end - attaching)));
+
+            if (onCompleted) {
+                onCompleted(retval);
+            }
+        });
+    });
 }
 
 
@@ -235,6 +594,17 @@ bool UDesktopDuplicator::Start(void) {
 void UDesktopDuplicator::Stop(void) noexcept {
     assert(IsInGameThread());
 
+    // An update in flight still uses the context, the staging texture and
+    // the buffers, which would be released beneath it. It clears the busy
+    // flag once it is done, so we only need to wait if the flag is set.
+    if (this->_busy) {
+        FlushRenderingCommands();
+    }
+
+    if (this->_coalesced != nullptr) {
+        this->_coalesced->Release();
+        this->_coalesced = nullptr;
+    }
     if (this->_context != nullptr) {
         this->_context->Release();
         this->_context = nullptr;
@@ -259,6 +629,214 @@ void UDesktopDuplicator::Stop(void) noexcept {
         this->_stagingTexture->Release();
         this->_stagingTexture = nullptr;
     }
+
+    this->_blocks.Empty();
+    this->_downscaled.Empty();
+    this->_failed.Empty();
+    this->_governor.Reset();
+    this->_lastUpdate = 0.0;
+    this->_metadata.Empty();
+    this->_pointerVisible = false;
+    this->_renderTime = 0.0f;
+    this->_rotated.Empty();
+    this->UpdateBufferSize();
+    this->_rotation = 0;
+    this->_scheduler.Resize(0, 0);
+    this->_yuv.Release();
+    this->_yuvFormat = EDesktopYuvFormat::None;
+    this->_yuvFullRange = false;
+}
+
+
+/*
+ * UDesktopDuplicator::Attach
+ */
+bool UDesktopDuplicator::Attach(FDesktopDuplicationSession& session) noexcept {
+    assert(IsInGameThread());
+    auto retval = (session.Duplication != nullptr);
+
+    if (retval && (this->_duplication != nullptr)) {
+        UE_LOG(DesktopDuplicatorLog,
+            Error,
+            TEXT("The desktop duplicator is already running."));
+        retval = false;
+    }
+
+    if (!retval) {
+        session.Release();
+        return false;
+    }
+
+    assert(this->_context == nullptr);
+    assert(this->_device == nullptr);
+    this->_context = session.Context;
+    this->_device = session.Device;
+    this->_duplication = session.Duplication;
+    this->_rotation = session.Rotation;
+    this->_lastUpdate = FPlatformTime::Seconds();
+    session = FDesktopDuplicationSession { };
+
+    if (this->_rotation != 0) {
+        UE_LOG(DesktopDuplicatorLog,
+            Display,
+            TEXT("Output \"%s\" is rotated by %d degrees."),
+            *this->DisplayName, 90 * this->_rotation);
+    }
+
+    return true;
+}
+
+
+/*
+ * UDesktopDuplicator::Coalesce
+ */
+void UDesktopDuplicator::Coalesce(void) noexcept {
+    assert(IsInGameThread());
+    assert(this->_busy);
+    if (this->_duplication == nullptr) {
+        return;
+    }
+
+    // If we still hold a coalesced frame, we cannot look at the next one
+    // without losing the content of the held one. This is not a problem,
+    // because DXGI accumulates the changes in the next frame.
+    if (this->_coalesced != nullptr) {
+        return;
+    }
+
+    // The previous frame has already been copied to the staging texture, so
+    // we can release it and look at the next one. We must not wait for the
+    // next one, though, because the game thread would stall.
+    this->_duplication->ReleaseFrame();
+
+    DXGI_OUTDUPL_FRAME_INFO info { };
+    IDXGIResource *resource = nullptr;
+    auto hr = this->_duplication->AcquireNextFrame(0, &info, &resource);
+    if (FAILED(hr)) {
+        if (hr != DXGI_ERROR_WAIT_TIMEOUT) {
+            UE_LOG(DesktopDuplicatorLog,
+                Verbose,
+                TEXT("Acquiring a frame for coalescing failed with error ")
+                TEXT("0x%x."), hr);
+        }
+        return;
+    }
+
+    ++this->_statistics.AcquiredFrames;
+    ++this->_statistics.CoalescedFrames;
+
+    if (info.LastMouseUpdateTime.QuadPart != 0) {
+        this->_pointer = FIntPoint(info.PointerPosition.Position.x,
+            info.PointerPosition.Position.y);
+        this->_pointerVisible = (info.PointerPosition.Visible != FALSE);
+    }
+
+    if (info.LastPresentTime.QuadPart != 0) {
+        this->CollectDirtyRegions(info.TotalMetadataBufferSize);
+    }
+
+    if (info.AccumulatedFrames != 0) {
+        // The regions we have just marked refer to the content of this frame,
+        // whereas the staging texture still holds the previous one. If we
+        // released the frame now, a later submission of the regions would
+        // upload stale content, so we hold it until it can be staged.
+        this->_lastUpdate = FPlatformTime::Seconds();
+        this->_coalesced = resource;
+
+    } else {
+        resource->Release();
+        this->_duplication->ReleaseFrame();
+    }
+}
+
+
+/*
+ * UDesktopDuplicator::CollectDirtyRegions
+ */
+void UDesktopDuplicator::CollectDirtyRegions(
+        const uint32 metadataSize) noexcept {
+    assert(this->_duplication != nullptr);
+    if (metadataSize == 0) {
+        // The desktop has changed, but we do not know where.
+        this->_scheduler.Invalidate();
+        return;
+    }
+
+    // The regions are reported for the duplicated surface, whereas the
+    // scheduler works on the rotated desktop. We derive the size of the
+    // surface from the scheduler, because the staging texture might have
+    // been trimmed. Before the first frame has been staged, the scheduler is
+    // empty and ignores the regions, but it will be invalidated once the
+    // staging texture has been created.
+    auto surface = this->_scheduler.GetSize();
+    if ((this->_rotation & 1) != 0) {
+        Swap(surface.X, surface.Y);
+    }
+
+    auto markDirty = [this, &surface](const RECT& r) {
+        this->_scheduler.MarkDirty(FDesktopImageKernels::RotateRegion(
+            FIntRect(r.left, r.top, r.right, r.bottom),
+            surface.X, surface.Y,
+            this->_rotation));
+    };
+
+    this->_metadata.SetNumUninitialized(metadataSize);
+    UINT size = 0;
+
+    // The source of a move is reported as dirty if it changed, so we only
+    // need to update the destination of a move.
+    auto hr = this->_duplication->GetFrameMoveRects(metadataSize,
+        reinterpret_cast<DXGI_OUTDUPL_MOVE_RECT *>(this->_metadata.GetData()),
+        &size);
+    if (SUCCEEDED(hr)) {
+        auto moves = reinterpret_cast<const DXGI_OUTDUPL_MOVE_RECT *>(
+            this->_metadata.GetData());
+        for (UINT i = 0; i < size / sizeof(DXGI_OUTDUPL_MOVE_RECT); ++i) {
+            markDirty(moves[i].DestinationRect);
+        }
+
+        hr = this->_duplication->GetFrameDirtyRects(metadataSize,
+            reinterpret_cast<RECT *>(this->_metadata.GetData()),
+            &size);
+    }
+
+    if (SUCCEEDED(hr)) {
+        auto dirty = reinterpret_cast<const RECT *>(this->_metadata.GetData());
+        for (UINT i = 0; i < size / sizeof(RECT); ++i) {
+            markDirty(dirty[i]);
+        }
+
+    } else {
+        UE_LOG(DesktopDuplicatorLog,
+            Warning,
+            TEXT("Retrieving the changed regions of the duplicated desktop ")
+            TEXT("failed with error 0x%x. Updating the whole desktop."),
+            hr);
+        this->_scheduler.Invalidate();
+    }
+}
+
+
+/*
+ * UDesktopDuplicator::ConvertYuv
+ */
+void UDesktopDuplicator::ConvertYuv(const uint8 *src,
+        const uint32 pitch,
+        const EDesktopYuvFormat format,
+        const bool fullRange,
+        const TArray<FIntRect>& regions) noexcept {
+    if (format == EDesktopYuvFormat::None) {
+        this->_yuv.Release();
+        return;
+    }
+
+    // If the planes are (re-)allocated, the scheduler has been invalidated
+    // by Stage or by a change of the size, so the regions cover the whole
+    // desktop. We must not convert more than the regions, because the
+    // rotated image is only valid within them.
+    const auto size = this->GetDesktopSize(this->_stagingTexture);
+    this->_yuv.Configure(size.X, size.Y, format, fullRange);
+    this->_yuv.Convert(src, pitch, regions);
 }
 
 
@@ -295,15 +873,36 @@ ID3D11Device *UDesktopDuplicator::CreateDevice(void) noexcept {
 
 
 /*
- * UDesktopDuplicator::GetOutputForDisplayName
+ * UDesktopDuplicator::GetDesktopSize
  */
-IDXGIOutput1 *UDesktopDuplicator::GetOutputForDisplayName(
-        const FString& name) noexcept {
-    // Convert 'name' into a regular expression.
-    auto displayName = name.Replace(TEXT("\\"), TEXT(""))
-        .Replace(TEXT("."), TEXT(""));
-    TString<wchar_t> displayPattern(TEXT(".*") + displayName + TEXT("$"));
-    std::wregex rx(*displayPattern, std::regex_constants::icase);
+FIntPoint UDesktopDuplicator::GetDesktopSize(
+        ID3D11Texture2D *texture) const noexcept {
+    assert(texture != nullptr);
+    D3D11_TEXTURE2D_DESC desc;
+    texture->GetDesc(&desc);
+    return ((this->_rotation & 1) != 0)
+        ? FIntPoint(desc.Height, desc.Width)
+        : FIntPoint(desc.Width, desc.Height);
+}
+
+
+/*
+ * UDesktopDuplicator::GetOutputsForDisplayNames
+ */
+TArray<IDXGIOutput1 *> UDesktopDuplicator::GetOutputsForDisplayNames(
+        const TArrayView<const FString> names) noexcept {
+    TArray<IDXGIOutput1 *> retval;
+    retval.SetNumZeroed(names.Num());
+
+    // Convert the names into regular expressions.
+    std::vector<std::wregex> rxs;
+    rxs.reserve(names.Num());
+    for (auto& n : names) {
+        auto displayName = n.Replace(TEXT("\\"), TEXT(""))
+            .Replace(TEXT("."), TEXT(""));
+        TString<wchar_t> displayPattern(TEXT(".*") + displayName + TEXT("$"));
+        rxs.emplace_back(*displayPattern, std::regex_constants::icase);
+    }
 
     // Obtain a DXGI factory.
     IDXGIFactory1 *factory = nullptr;
@@ -316,7 +915,8 @@ IDXGIOutput1 *UDesktopDuplicator::GetOutputForDisplayName(
             TEXT("Failed to obtain DXGI factory with error 0x%x."), hr);
     }
 
-    // Enumerate all adapters and their outputs.
+    // Enumerate all adapters and their outputs once and match them against
+    // all names that have not been found yet.
     for (DWORD a = 0; SUCCEEDED(hr); ++a) {
         IDXGIAdapter1 *adapter = nullptr;
         auto ir = hr = factory->EnumAdapters1(a, &adapter);
@@ -334,35 +934,42 @@ IDXGIOutput1 *UDesktopDuplicator::GetOutputForDisplayName(
             ON_SCOPE_EXIT { if (output != nullptr) { output->Release(); } };
 
             // If we got another output, retrieve its description to check its
-            // name. If it is the one we are looking for, retrieve its DXGI 1.2
+            // name. If it is one we are looking for, retrieve its DXGI 1.2
             // interface required for desktop duplication.
             if (SUCCEEDED(ir)) {
                 DXGI_OUTPUT_DESC desc;
                 ir = output->GetDesc(&desc);
                 assert(SUCCEEDED(ir));
 
-                if (std::regex_match(desc.DeviceName, rx)) {
-                    UE_LOG(DesktopDuplicatorLog,
-                        Display,
-                        TEXT("Found DXGI output \"%ls\"."), desc.DeviceName);
-                    IDXGIOutput1 *retval = nullptr;
-                    if (FAILED(output->QueryInterface(
-                            ::IID_IDXGIOutput1,
-                            reinterpret_cast<void **>(&retval)))) {
+                for (int32 i = 0; i < names.Num(); ++i) {
+                    if (retval[i] != nullptr) {
+                        continue;
+                    }
+
+                    if (std::regex_match(desc.DeviceName, rxs[i])) {
                         UE_LOG(DesktopDuplicatorLog,
-                            Error,
-                            TEXT("Found the requested output \"%ls\", but it ")
-                            TEXT("does not support DXGI 1.2, which is ")
-                            TEXT("required for desktop duplication."),
+                            Display,
+                            TEXT("Found DXGI output \"%ls\"."),
                             desc.DeviceName);
+                        if (FAILED(output->QueryInterface(
+                                ::IID_IDXGIOutput1,
+                                reinterpret_cast<void **>(&retval[i])))) {
+                            UE_LOG(DesktopDuplicatorLog,
+                                Error,
+                                TEXT("Found the requested output \"%ls\", ")
+                                TEXT("but it does not support DXGI 1.2, ")
+                                TEXT("which is required for desktop ")
+                                TEXT("duplication."),
+                                desc.DeviceName);
+                            retval[i] = nullptr;
+                        }
+                    } else {
+                        UE_LOG(DesktopDuplicatorLog,
+                            Display,
+                            TEXT("DXGI output \"%ls\" does not match ")
+                            TEXT("\"%s\"."),
+                            desc.DeviceName, *names[i]);
                     }
-
-                    return retval;
-                } else {
-                    UE_LOG(DesktopDuplicatorLog,
-                        Display,
-                        TEXT("DXGI output \"%ls\" does not match \"%s\"."),
-                        desc.DeviceName, *name);
                 }
             } else if (ir != DXGI_ERROR_NOT_FOUND) {
                 UE_LOG(DesktopDuplicatorLog,
@@ -373,11 +980,70 @@ IDXGIOutput1 *UDesktopDuplicator::GetOutputForDisplayName(
         } /* for (DWORD o = 0; SUCCEEDED(ir); ++o) */
     } /* for (DWORD a = 0; SUCCEEDED(hr); ++a) */
 
-    UE_LOG(DesktopDuplicatorLog,
-        Error,
-        TEXT("Could not find output \"%s\" to be duplicated."),
-        *name);
-    return nullptr;
+    for (int32 i = 0; i < names.Num(); ++i) {
+        if (retval[i] == nullptr) {
+            UE_LOG(DesktopDuplicatorLog,
+                Error,
+                TEXT("Could not find output \"%s\" to be duplicated."),
+                *names[i]);
+        }
+    }
+
+    return retval;
+}
+
+
+/*
+ * UDesktopDuplicator::IsHalfResolution
+ */
+bool UDesktopDuplicator::IsHalfResolution(void) const noexcept {
+    // Downscaling is only possible if the data pass through the CPU, so the
+    // GPU path can only reduce its frame rate. Block-compressed uploads are
+    // small enough to be always performed at full resolution.
+    return this->_governor.IsHalfResolution()
+        && (this->_stagingProjection == nullptr)
+        && (this->Compression == EDesktopBlockCompression::None);
+}
+
+
+/*
+ * UDesktopDuplicator::MatchCompressedTarget
+ */
+bool UDesktopDuplicator::MatchCompressedTarget(
+        ID3D11Texture2D *texture) noexcept {
+    assert(texture != nullptr);
+    const auto size = this->GetDesktopSize(texture);
+
+    // Block-compressed textures must consist of whole blocks, so the desktop
+    // is padded to a multiple of four.
+    const auto format = FDesktopBlockEncoder::GetPixelFormat(this->Compression);
+    const auto width = Align(size.X, 4);
+    const auto height = Align(size.Y, 4);
+    const auto retval = (this->CompressedTarget != nullptr)
+        && (this->CompressedTarget->GetSizeX() == width)
+        && (this->CompressedTarget->GetSizeY() == height)
+        && (this->CompressedTarget->GetPixelFormat() == format);
+
+    if (!retval) {
+        UE_LOG(DesktopDuplicatorLog,
+            Display,
+            TEXT("Creating block-compressed desktop duplication target."));
+        this->CompressedTarget = UTexture2D::CreateTransient(width,
+            height,
+            format);
+        if (this->CompressedTarget != nullptr) {
+            this->CompressedTarget->SRGB = true;
+            this->CompressedTarget->UpdateResource();
+        } else {
+            UE_LOG(DesktopDuplicatorLog,
+                Error,
+                TEXT("Creating a block-compressed texture of %d x %d pixels ")
+                TEXT("for desktop duplication failed."), width, height);
+        }
+        this->_scheduler.Invalidate();
+    }
+
+    return retval;
 }
 
 
@@ -399,7 +1065,8 @@ bool UDesktopDuplicator::MatchStaging(ID3D11Texture2D *texture) noexcept {
         const auto match
             = (curDesc.Width == desc.Width)
             && (curDesc.Height == desc.Height)
-            && (curDesc.Format == desc.Format);
+            && (curDesc.Format == desc.Format)
+            && ((curDesc.CPUAccessFlags == 0) == this->UseGpuCopy());
 
         if (!match) {
             UE_LOG(DesktopDuplicatorLog,
@@ -416,7 +1083,7 @@ bool UDesktopDuplicator::MatchStaging(ID3D11Texture2D *texture) noexcept {
     } /* if (this->_stagingTexture != nullptr) */
 
     if (this->_stagingTexture == nullptr) {
-        const auto gpuCopy = this->AllowGpuCopy && (::IsRHID3D11());
+        const auto gpuCopy = this->UseGpuCopy();
         desc.CPUAccessFlags = gpuCopy ? 0 : D3D11_CPU_ACCESS_READ;
         desc.Usage = gpuCopy ? D3D11_USAGE_DEFAULT : D3D11_USAGE_STAGING;
         desc.BindFlags = 0;
@@ -432,37 +1099,40 @@ bool UDesktopDuplicator::MatchStaging(ID3D11Texture2D *texture) noexcept {
         }
     }
 
-    if (this->AllowGpuCopy
+    if (this->UseGpuCopy()
             && (this->_stagingTexture != nullptr)
             && (this->_stagingProjection == nullptr)) {
-        if (::IsRHID3D11()) {
-            HANDLE handle = NULL;
-            IDXGIResource *resource = nullptr;
-
-            auto hr = this->_stagingTexture->QueryInterface(&resource);
-            if (SUCCEEDED(hr)) {
-                hr = resource->GetSharedHandle(&handle);
-                resource->Release();
-            }
+        HANDLE handle = NULL;
+        IDXGIResource *resource = nullptr;
 
-            if (SUCCEEDED(hr)) {
-                const auto rhi = ::GetID3D11DynamicRHI();
-                assert(this->_stagingProjection == nullptr);
-                hr = rhi->RHIGetDevice()->OpenSharedResource(
-                    handle,
-                    ::IID_ID3D11Texture2D,
-                    reinterpret_cast<void **>(&this->_stagingProjection));
-            }
+        auto hr = this->_stagingTexture->QueryInterface(&resource);
+        if (SUCCEEDED(hr)) {
+            hr = resource->GetSharedHandle(&handle);
+            resource->Release();
+        }
 
-            if (FAILED(hr)) {
-                UE_LOG(DesktopDuplicatorLog,
-                    Warning,
-                    TEXT("Opening the desktop duplication staging texture on ")
-                    TEXT("the engine's device failed with error 0x%x."), hr);
-                assert(this->_stagingProjection == nullptr);
-            }
+        if (SUCCEEDED(hr)) {
+            const auto rhi = ::GetID3D11DynamicRHI();
+            assert(this->_stagingProjection == nullptr);
+            hr = rhi->RHIGetDevice()->OpenSharedResource(
+                handle,
+                ::IID_ID3D11Texture2D,
+                reinterpret_cast<void **>(&this->_stagingProjection));
+        }
+
+        if (FAILED(hr)) {
+            UE_LOG(DesktopDuplicatorLog,
+                Warning,
+                TEXT("Opening the desktop duplication staging texture on ")
+                TEXT("the engine's device failed with error 0x%x."), hr);
+            assert(this->_stagingProjection == nullptr);
         }
-    } /* if (this->AllowGpuCopy ... */
+    } /* if (this->UseGpuCopy() ... */
+
+    if (this->_stagingTexture != nullptr) {
+        const auto size = this->GetDesktopSize(this->_stagingTexture);
+        this->_scheduler.Resize(size.X, size.Y);
+    }
 
     return (this->_stagingTexture != nullptr);
 }
@@ -471,31 +1141,154 @@ bool UDesktopDuplicator::MatchStaging(ID3D11Texture2D *texture) noexcept {
 /*
  * UDesktopDuplicator::MatchTarget
  */
-bool UDesktopDuplicator::MatchTarget(ID3D11Texture2D *texture) noexcept {
+bool UDesktopDuplicator::MatchTarget(ID3D11Texture2D *texture,
+        const bool half) noexcept {
     assert(texture != nullptr);
-    D3D11_TEXTURE2D_DESC desc;
-    texture->GetDesc(&desc);
-    assert(desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM);
-
-    const auto retval = HasSize(this->Target, desc.Width, desc.Height);
+    const auto size = this->GetDesktopSize(texture);
+    const auto width = half ? size.X / 2 : size.X;
+    const auto height = half ? size.Y / 2 : size.Y;
+    const auto retval = HasSize(this->Target, width, height);
 
     if (!retval && (this->Target != nullptr)) {
         UE_LOG(DesktopDuplicatorLog,
             Display,
             TEXT("Resizing desktop duplication target."));
-        this->Target->InitCustomFormat(desc.Width,
-            desc.Height,
+        this->Target->InitCustomFormat(width,
+            height,
             EPixelFormat::PF_B8G8R8A8,
             false);
         this->Target->RenderTargetFormat
             = ETextureRenderTargetFormat::RTF_RGBA8;
         this->Target->UpdateResource();
+        this->_scheduler.Invalidate();
     }
 
     return retval;
 }
 
 
+/*
+ * UDesktopDuplicator::MatchTargets
+ */
+bool UDesktopDuplicator::MatchTargets(ID3D11Texture2D *texture) noexcept {
+    assert(texture != nullptr);
+
+    if (this->Compression != this->_compression) {
+        // The tiles have been cleaned for the other target, which is
+        // therefore stale.
+        this->_compression = this->Compression;
+        this->_scheduler.Invalidate();
+    }
+
+    if ((this->YuvFormat != this->_yuvFormat)
+            || (this->YuvFullRange != this->_yuvFullRange)) {
+        // The YUV planes are re-created, so they need to be converted from
+        // the whole desktop.
+        this->_yuvFormat = this->YuvFormat;
+        this->_yuvFullRange = this->YuvFullRange;
+        this->_scheduler.Invalidate();
+    }
+
+    return (this->Compression == EDesktopBlockCompression::None)
+        ? this->MatchTarget(texture, this->IsHalfResolution())
+        : this->MatchCompressedTarget(texture);
+}
+
+
+/*
+ * UDesktopDuplicator::Open
+ */
+bool UDesktopDuplicator::Open(FDesktopDuplicationSession& session,
+        IDXGIOutput1 *output,
+        const FString& name) noexcept {
+    assert(output != nullptr);
+    assert(session.Device == nullptr);
+
+    // Create the device that is used for duplication. In theory, we should be
+    // able to use the one created by Unreal Engine if the RHI is D3D11, but
+    // this is extremely unstable.
+    session.Device = CreateDevice();
+
+    if (session.Device != nullptr) {
+        session.OpenContext();
+    }
+
+    if (session.Device != nullptr) {
+        auto hr = output->DuplicateOutput(session.Device,
+            &session.Duplication);
+        if (FAILED(hr)) {
+            UE_LOG(DesktopDuplicatorLog,
+                Error,
+                TEXT("Duplicating output \"%s\" failed with with error 0x%x."),
+                *name, hr);
+            assert(session.Duplication == nullptr);
+        }
+    }
+
+    if (session.Duplication != nullptr) {
+        session.ReadRotation();
+    }
+
+    return (session.Duplication != nullptr);
+}
+
+
+/*
+ * UDesktopDuplicator::Rotate
+ */
+const uint8 *UDesktopDuplicator::Rotate(const uint8 *src,
+        uint32& pitch,
+        const TArray<FIntRect>& regions) noexcept {
+    if (this->_rotation == 0) {
+        return src;
+    }
+
+    D3D11_TEXTURE2D_DESC desc;
+    this->_stagingTexture->GetDesc(&desc);
+    const auto size = this->GetDesktopSize(this->_stagingTexture);
+    const auto dstPitch = 4 * static_cast<uint32>(size.X);
+    const auto dstSize = static_cast<int32>(dstPitch * size.Y);
+    if (this->_rotated.Num() != dstSize) {
+        this->_rotated.SetNumUninitialized(dstSize);
+    }
+
+    // The regions are on the desktop, so we need to rotate them back to find
+    // their source on the duplicated surface. Each region is split into
+    // strips that are rotated in parallel.
+    constexpr int32 stripHeight = 64;
+    const auto inverse = 4 - this->_rotation;
+    auto dst = this->_rotated.GetData();
+    for (auto& r : regions) {
+        const auto s = FDesktopImageKernels::RotateRegion(r,
+            size.X, size.Y,
+            inverse);
+        const auto strips = (s.Height() + stripHeight - 1) / stripHeight;
+
+        ParallelFor(strips, [&](const int32 i) {
+            // A strip of the source ends up in a strip of the destination,
+            // which we find by rotating it back.
+            const FIntRect strip(s.Min.X,
+                s.Min.Y + i * stripHeight,
+                s.Max.X,
+                (std::min)(s.Min.Y + (i + 1) * stripHeight, s.Max.Y));
+            const auto d = FDesktopImageKernels::RotateRegion(strip,
+                desc.Width, desc.Height,
+                this->_rotation);
+            FDesktopImageKernels::Rotate(
+                dst + d.Min.Y * dstPitch + 4 * d.Min.X,
+                dstPitch,
+                src + strip.Min.Y * pitch + 4 * strip.Min.X,
+                pitch,
+                strip.Width(), strip.Height(),
+                this->_rotation);
+        });
+    }
+
+    pitch = dstPitch;
+    return dst;
+}
+
+
 /*
  * UDesktopDuplicator::Stage
  */
@@ -532,100 +1325,348 @@ bool UDesktopDuplicator::Stage(IDXGIResource *resource) noexcept {
         retval = false;
     }
 
-    if (retval && !this->MatchTarget(texture)) {
+    if (retval && !this->MatchTargets(texture)) {
+        // The frame must be staged nevertheless, because DXGI will not report
+        // its changes again and a timeout would otherwise upload the stale
+        // content of the staging texture. The re-created target has been
+        // invalidated, so the whole desktop is uploaded.
         UE_LOG(DesktopDuplicatorLog,
             Display,
-            TEXT("Dropping desktop duplication as the target needs to be ")
-            TEXT("resized."));
-        retval = false;
+            TEXT("The desktop duplication target has been re-created."));
     }
 
     if (retval) {
         assert(this->_context != nullptr);
         assert(this->_stagingTexture != nullptr);
         this->_context->CopyResource(this->_stagingTexture, texture);
+    }
 
-        if (this->_stagingProjection != nullptr) {
-            // We have a copy of the staging buffer on the UE device, so it is
-            // possible to perform the update solely on the GPU.
-            assert(this->AllowGpuCopy);
-
-            ENQUEUE_RENDER_COMMAND(CopyRTCommand)(
-                [this](FRHICommandListImmediate& cmdList) {
-                    assert(texture != nullptr);
-                    auto rhi = ::GetID3D11DynamicRHI();
-                    ID3D11Texture2D *staging = nullptr;
-                    this->_stagingProjection->QueryInterface(
-                        ::IID_ID3D11Texture2D,
-                        reinterpret_cast<void **>(&staging));
-                    auto src = rhi->RHICreateTexture2DFromResource(
-                        EPixelFormat::PF_B8G8R8A8,
-                        ETextureCreateFlags::None,
-                        FClearValueBinding::None,
-                        staging);
-                    src->SetName(TEXT("Desktop source"));
-                    auto dst = this->Target
-                        ->GetRenderTargetResource()
-                        ->GetRenderTargetTexture();
-
-                    FRHIRenderPassInfo rpi(dst,
-                        ERenderTargetActions::Load_Store);
-                    //cmdList.BeginRenderPass(rpi, TEXT("CopyRT"));
-                    cmdList.CopyTexture(src, dst, FRHICopyTextureInfo());
-                    //cmdList.EndRenderPass();
-
-                    src.SafeRelease();
-                    staging->Release();
-    //                this->_duplication->ReleaseFrame();
-                    this->_busy.AtomicSet(false);
-                });
+    if (texture != nullptr) {
+        texture->Release();
+    }
+
+    if (retval) {
+        // The staging texture now holds the whole desktop, so any dirty tile
+        // can be uploaded from there, including the ones deferred earlier.
+        retval = this->Submit();
+
+    } else {
+        UE_LOG(DesktopDuplicatorLog,
+            Warning,
+            TEXT("Cleaning up resources of failed staging attempt of ")
+            TEXT("duplicated desktop."));
+//        this->_duplication->ReleaseFrame();
+        this->_busy.AtomicSet(false);
+    }
+
+    return retval;
+}
 
+
+/*
+ * UDesktopDuplicator::Submit
+ */
+bool UDesktopDuplicator::Submit(void) noexcept {
+    assert(this->_busy);
+    auto retval = (this->_stagingTexture != nullptr);
+    const auto compression = this->_compression;
+    const auto fullRange = this->_yuvFullRange;
+    const auto half = this->IsHalfResolution();
+    const auto yuv = this->_yuvFormat;
+
+    if (retval) {
+        // The target is matched whenever a frame is staged or the
+        // acquisition times out, so this only fails if it could not be
+        // created.
+        const auto size = this->GetDesktopSize(this->_stagingTexture);
+        if (compression != EDesktopBlockCompression::None) {
+            retval = (compression == this->Compression)
+                && (this->CompressedTarget != nullptr)
+                && (this->CompressedTarget->GetSizeX() == Align(size.X, 4))
+                && (this->CompressedTarget->GetSizeY() == Align(size.Y, 4));
         } else {
-            // We must download the data and populate the target from the CPU.
-            ENQUEUE_RENDER_COMMAND(UpdateRTCommand)(
-                [this, texture](FRHICommandListImmediate& cmdList) {
-                    D3D11_MAPPED_SUBRESOURCE data { };
-                    auto hr = this->_context->Map(this->_stagingTexture,
-                        0, D3D11_MAP_READ, 0, &data);
-                    if (FAILED(hr)) {
-                        UE_LOG(DesktopDuplicatorLog,
-                            Error,
-                            TEXT("Mapping the staging texture for desktop ")
-                            TEXT("duplication failed with error 0x%x."), hr);
-                        return;
-                    }
+            retval = (compression == this->Compression)
+                && (half
+                ? HasSize(this->Target, size.X / 2, size.Y / 2)
+                : HasSize(this->Target, size.X, size.Y));
+        }
+    }
+
+    if (retval) {
+        auto focus = this->FocusPoints;
+        if (this->FollowPointer && this->_pointerVisible) {
+            focus.Add(this->_pointer);
+        }
+
+        this->_scheduler.SetPeriphery(this->PeripheralInterval,
+            this->MaxUpdateLatency);
+        this->_scheduler.SetFocus(focus, this->FocusRadius);
+        this->_scheduler.Schedule(this->_regions,
+            (this->_governor.GetLevel() >= EDesktopDuplicationLoad::CoarseUpdates)
+            ? 4 : 1);
+        retval = !this->_regions.IsEmpty();
+    }
+
+    if (retval) {
+        ++this->_statistics.SubmittedFrames;
+    }
+
+    if (retval && (this->_stagingProjection != nullptr)) {
+        // We have a copy of the staging buffer on the UE device, so it is
+        // possible to perform the update solely on the GPU.
+        assert(this->AllowGpuCopy);
+
+        ENQUEUE_RENDER_COMMAND(CopyRTCommand)(
+            [this, regions = this->_regions](FRHICommandListImmediate& cmdList) {
+                const auto start = FPlatformTime::Seconds();
+                auto rhi = ::GetID3D11DynamicRHI();
+                ID3D11Texture2D *staging = nullptr;
+                this->_stagingProjection->QueryInterface(
+                    ::IID_ID3D11Texture2D,
+                    reinterpret_cast<void **>(&staging));
+                auto src = rhi->RHICreateTexture2DFromResource(
+                    EPixelFormat::PF_B8G8R8A8,
+                    ETextureCreateFlags::None,
+                    FClearValueBinding::None,
+                    staging);
+                src->SetName(TEXT("Desktop source"));
+                auto dst = this->Target
+                    ->GetRenderTargetResource()
+                    ->GetRenderTargetTexture();
+
+                for (auto& r : regions) {
+                    FRHICopyTextureInfo info;
+                    info.Size = FIntVector(r.Width(), r.Height(), 1);
+                    info.SourcePosition = FIntVector(r.Min.X, r.Min.Y, 0);
+                    info.DestPosition = info.SourcePosition;
+                    cmdList.CopyTexture(src, dst, info);
+                }
 
-                    FUpdateTextureRegion2D region(0, 0, 0, 0,
-                        this->Target->GetSurfaceWidth(),
-                        this->Target->GetSurfaceHeight());
+                src.SafeRelease();
+                staging->Release();
+//                this->_duplication->ReleaseFrame();
+                this->_renderTime = static_cast<float>(
+                    1000.0 * (FPlatformTime::Seconds() - start));
+                this->_busy.AtomicSet(false);
+            });
+
+    } else if (retval && (compression != EDesktopBlockCompression::None)) {
+        // We must download the data and encode the blocks on the CPU.
+        ENQUEUE_RENDER_COMMAND(EncodeRTCommand)(
+            [this, compression, yuv, fullRange, regions = this->_regions](
+                    FRHICommandListImmediate& cmdList) {
+                const auto start = FPlatformTime::Seconds();
+                D3D11_MAPPED_SUBRESOURCE data { };
+                auto hr = this->_context->Map(this->_stagingTexture,
+                    0, D3D11_MAP_READ, 0, &data);
+                if (FAILED(hr)) {
+                    UE_LOG(DesktopDuplicatorLog,
+                        Error,
+                        TEXT("Mapping the staging texture for desktop ")
+                        TEXT("duplication failed with error 0x%x."), hr);
+                    this->_failed = regions;
+                    this->_busy.AtomicSet(false);
+                    return;
+                }
 
-                    auto res = this->Target->GetRenderTargetResource();
-                    GDynamicRHI->RHIUpdateTexture2D(
-                        cmdList,
-                        res->GetRenderTargetTexture(),
-                        0,
-                        region,
-                        data.RowPitch,
-                        static_cast<const uint8 *>(data.pData));
+                uint32 rowPitch = data.RowPitch;
+                auto src = this->Rotate(static_cast<const uint8 *>(data.pData),
+                    rowPitch, regions);
+                this->ConvertYuv(src, rowPitch, yuv, fullRange, regions);
+
+                const auto desktop = this->GetDesktopSize(
+                    this->_stagingTexture);
+                const auto blockSize = FDesktopBlockEncoder::GetBlockSize(
+                    compression);
+                const auto pitch = blockSize * ((desktop.X + 3) / 4);
+                const auto size = static_cast<int32>(
+                    pitch * ((desktop.Y + 3) / 4));
+                if (this->_blocks.Num() != size) {
+                    this->_blocks.SetNumUninitialized(size);
+                }
 
-                    this->_context->Unmap(this->_stagingTexture, 0);
+                auto dst = this->CompressedTarget
+                    ->GetResource()
+                    ->GetTexture2DRHI();
+
+                for (auto& r : regions) {
+                    FDesktopBlockEncoder::Encode(this->_blocks.GetData(),
+                        pitch,
+                        src, rowPitch,
+                        desktop.X, desktop.Y,
+                        r,
+                        compression);
+
+                    const auto left = r.Min.X & ~3;
+                    const auto top = r.Min.Y & ~3;
+                    FUpdateTextureRegion2D region(left,
+                        top,
+                        0, 0,
+                        Align(r.Max.X, 4) - left,
+                        Align(r.Max.Y, 4) - top);
+                    GDynamicRHI->RHIUpdateTexture2D(cmdList,
+                        dst, 0, region, pitch,
+                        this->_blocks.GetData()
+                        + (top / 4) * pitch
+                        + (left / 4) * blockSize);
+                }
+
+                this->_context->Unmap(this->_stagingTexture, 0);
+                this->UpdateBufferSize();
+                this->_renderTime = static_cast<float>(
+                    1000.0 * (FPlatformTime::Seconds() - start));
+                this->_busy.AtomicSet(false);
+            });
+
+    } else if (retval) {
+        // We must download the data and populate the target from the CPU.
+        ENQUEUE_RENDER_COMMAND(UpdateRTCommand)(
+            [this, half, yuv, fullRange, regions = this->_regions](
+                    FRHICommandListImmediate& cmdList) {
+                const auto start = FPlatformTime::Seconds();
+                D3D11_MAPPED_SUBRESOURCE data { };
+                auto hr = this->_context->Map(this->_stagingTexture,
+                    0, D3D11_MAP_READ, 0, &data);
+                if (FAILED(hr)) {
+                    UE_LOG(DesktopDuplicatorLog,
+                        Error,
+                        TEXT("Mapping the staging texture for desktop ")
+                        TEXT("duplication failed with error 0x%x."), hr);
+                    this->_failed = regions;
                     this->_busy.AtomicSet(false);
-                });
-        } /* if (this->_stagingProjection != nullptr) */
-    } /* if (retval) */
+                    return;
+                }
 
-    if (!retval) {
+                uint32 rowPitch = data.RowPitch;
+                auto src = this->Rotate(static_cast<const uint8 *>(data.pData),
+                    rowPitch, regions);
+                this->ConvertYuv(src, rowPitch, yuv, fullRange, regions);
+
+                auto dst = this->Target
+                    ->GetRenderTargetResource()
+                    ->GetRenderTargetTexture();
+
+                if (half) {
+                    // Downscale all regions into separate parts of the buffer
+                    // such that none of them is overwritten before the RHI
+                    // has consumed it.
+                    int32 size = 0;
+                    for (auto& r : regions) {
+                        size += 4 * (r.Width() / 2) * (r.Height() / 2);
+                    }
+                    this->_downscaled.SetNumUninitialized(size);
+
+                    auto d = this->_downscaled.GetData();
+                    for (auto& r : regions) {
+                        FUpdateTextureRegion2D region(r.Min.X / 2,
+                            r.Min.Y / 2,
+                            0, 0,
+                            r.Width() / 2,
+                            r.Height() / 2);
+                        if ((region.Width == 0) || (region.Height == 0)) {
+                            continue;
+                        }
+
+                        const auto pitch = 4 * region.Width;
+                        FDesktopImageKernels::DownscaleHalf(d, pitch,
+                            src + r.Min.Y * rowPitch + 4 * r.Min.X,
+                            rowPitch,
+                            r.Width(), r.Height());
+                        GDynamicRHI->RHIUpdateTexture2D(cmdList,
+                            dst, 0, region, pitch, d);
+                        d += pitch * region.Height;
+                    }
+
+                } else {
+                    for (auto& r : regions) {
+                        FUpdateTextureRegion2D region(r.Min.X,
+                            r.Min.Y,
+                            0, 0,
+                            r.Width(),
+                            r.Height());
+                        GDynamicRHI->RHIUpdateTexture2D(cmdList,
+                            dst, 0, region, rowPitch,
+                            src + r.Min.Y * rowPitch + 4 * r.Min.X);
+                    }
+                }
+
+                this->_context->Unmap(this->_stagingTexture, 0);
+                this->UpdateBufferSize();
+                this->_renderTime = static_cast<float>(
+                    1000.0 * (FPlatformTime::Seconds() - start));
+                this->_busy.AtomicSet(false);
+            });
+
+    } else {
         UE_LOG(DesktopDuplicatorLog,
-            Warning,
-            TEXT("Cleaning up resources of failed staging attempt of ")
-            TEXT("duplicated desktop."));
-//        this->_duplication->ReleaseFrame();
+            Verbose,
+            TEXT("No part of the duplicated desktop is due for an update."));
         this->_busy.AtomicSet(false);
     }
 
-    if (texture != nullptr) {
-        texture->Release();
+    return retval;
+}
+
+
+/*
+ * UDesktopDuplicator::TrimIdle
+ */
+bool UDesktopDuplicator::TrimIdle(void) noexcept {
+    assert(this->_busy);
+    const auto idle = FPlatformTime::Seconds() - this->_lastUpdate;
+    const auto retval = (this->IdleTimeout > 0.0f)
+        && (idle >= this->IdleTimeout)
+        && (this->_stagingTexture != nullptr)
+        && !this->_scheduler.HasPending();
+
+    if (retval) {
+        // As we own the busy flag, the render thread cannot use any of the
+        // staging resources at the moment. The content of the targets and the
+        // state of the scheduler remain valid, so the staging resources can
+        // be re-created for the next change without a full update.
+        UE_LOG(DesktopDuplicatorLog,
+            Display,
+            TEXT("Releasing the staging resources of the desktop duplication ")
+            TEXT("of \"%s\" after %f s without changes."),
+            *this->DisplayName, idle);
+        if (this->_stagingProjection != nullptr) {
+            this->_stagingProjection->Release();
+            this->_stagingProjection = nullptr;
+        }
+
+        this->_stagingTexture->Release();
+        this->_stagingTexture = nullptr;
+
+        this->_blocks.Empty();
+        this->_downscaled.Empty();
+        this->_metadata.Empty();
+        this->_regions.Empty();
+        this->_rotated.Empty();
+        this->UpdateBufferSize();
     }
 
     return retval;
 }
+
+
+/*
+ * UDesktopDuplicator::UpdateBufferSize
+ */
+void UDesktopDuplicator::UpdateBufferSize(void) noexcept {
+    this->_bufferSize = this->_blocks.GetAllocatedSize()
+        + this->_downscaled.GetAllocatedSize()
+        + this->_rotated.GetAllocatedSize();
+}
+
+
+/*
+ * UDesktopDuplicator::UseGpuCopy
+ */
+bool UDesktopDuplicator::UseGpuCopy(void) const noexcept {
+    // The copy engine cannot rotate, so rotated outputs use the CPU path.
+    return this->AllowGpuCopy
+        && ::IsRHID3D11()
+        && (this->_rotation == 0)
+        && (this->Compression == EDesktopBlockCompression::None)
+        && (this->YuvFormat == EDesktopYuvFormat::None);
+}
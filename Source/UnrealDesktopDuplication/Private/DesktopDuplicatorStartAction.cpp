@@ -0,0 +1,56 @@
+// <copyright file="DesktopDuplicatorStartAction.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "DesktopDuplicatorStartAction.h"
+
+
+/*
+ * UDesktopDuplicatorStartAction::Activate
+ */
+void UDesktopDuplicatorStartAction::Activate(void) {
+    // The action is kept alive by the game instance until it is ready to be
+    // destroyed, but the game instance itself might go away in the meantime.
+    TWeakObjectPtr<UDesktopDuplicatorStartAction> self(this);
+
+    UDesktopDuplicator::StartAsync(this->_duplicators,
+            [self](const TArray<bool>& started) {
+        auto action = self.Get();
+        if (action == nullptr) {
+            return;
+        }
+
+        if (started.Contains(false)) {
+            action->Failure.Broadcast();
+        } else {
+            action->Success.Broadcast();
+        }
+
+        action->SetReadyToDestroy();
+    });
+}
+
+
+/*
+ * UDesktopDuplicatorStartAction::StartAllAsync
+ */
+UDesktopDuplicatorStartAction *UDesktopDuplicatorStartAction::StartAllAsync(
+        UObject *worldContext,
+        const TArray<UDesktopDuplicator *>& duplicators) {
+    auto retval = NewObject<UDesktopDuplicatorStartAction>();
+    retval->_duplicators = duplicators;
+    retval->RegisterWithGameInstance(worldContext);
+    return retval;
+}
+
+
+/*
+ * UDesktopDuplicatorStartAction::StartAsync
+ */
+UDesktopDuplicatorStartAction *UDesktopDuplicatorStartAction::StartAsync(
+        UObject *worldContext,
+        UDesktopDuplicator *duplicator) {
+    return StartAllAsync(worldContext, { duplicator });
+}
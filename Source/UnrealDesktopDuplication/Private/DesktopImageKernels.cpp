@@ -0,0 +1,423 @@
+// <copyright file="DesktopImageKernels.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "DesktopImageKernels.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <tmmintrin.h>
+
+
+namespace {
+
+    /// <summary>
+    /// The edge length in pixels of the tiles in which images are rotated by
+    /// a quarter turn, which is chosen such that the source and the
+    /// destination tile fit into the L1 cache together.
+    /// </summary>
+    constexpr uint32 RotationTile = 64;
+
+    /// <summary>
+    /// Copies a single 32-bit pixel.
+    /// </summary>
+    inline void CopyPixel(uint8 *dst, const uint8 *src) noexcept {
+        ::memcpy(dst, src, 4);
+    }
+
+    /// <summary>
+    /// Transposes a block of 4x4 32-bit pixels in place.
+    /// </summary>
+    inline void Transpose(__m128i (&rows)[4]) noexcept {
+        const auto t0 = _mm_unpacklo_epi32(rows[0], rows[1]);
+        const auto t1 = _mm_unpacklo_epi32(rows[2], rows[3]);
+        const auto t2 = _mm_unpackhi_epi32(rows[0], rows[1]);
+        const auto t3 = _mm_unpackhi_epi32(rows[2], rows[3]);
+        rows[0] = _mm_unpacklo_epi64(t0, t1);
+        rows[1] = _mm_unpackhi_epi64(t0, t1);
+        rows[2] = _mm_unpacklo_epi64(t2, t3);
+        rows[3] = _mm_unpackhi_epi64(t2, t3);
+    }
+
+    /// <summary>
+    /// The fixed-point precision of the colour conversion coefficients.
+    /// </summary>
+    constexpr int32 YuvPrecision = 14;
+
+    /// <summary>
+    /// The BT.709 coefficients for Y, Cb and Cr in BGRA order for the limited
+    /// and the full range, scaled by 2^<see cref="YuvPrecision"/>.
+    /// </summary>
+    constexpr int16 YuvCoefficients[2][3][4] = {
+        {
+            { 1016, 10064, 2992, 0 },
+            { 7196, -5547, -1649, 0 },
+            { -660, -6536, 7196, 0 }
+        },
+        {
+            { 1183, 11718, 3483, 0 },
+            { 8192, -6315, -1877, 0 },
+            { -751, -7441, 8192, 0 }
+        }
+    };
+
+    /// <summary>
+    /// The offsets added to Y, Cb and Cr for the limited and the full range.
+    /// </summary>
+    constexpr int32 YuvOffsets[2][3] = {
+        { 16, 128, 128 },
+        { 0, 128, 128 }
+    };
+
+    /// <summary>
+    /// Computes one component of four BGRA pixels in fixed point.
+    /// </summary>
+    inline __m128i YuvDot(const __m128i pixels,
+            const __m128i coefficients,
+            const __m128i offset) noexcept {
+        const auto zero = _mm_setzero_si128();
+        const auto lo = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero),
+            coefficients);
+        const auto hi = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero),
+            coefficients);
+        return _mm_srai_epi32(_mm_add_epi32(_mm_hadd_epi32(lo, hi), offset),
+            YuvPrecision);
+    }
+
+    /// <summary>
+    /// Computes one component of a single BGRA pixel in fixed point.
+    /// </summary>
+    inline uint8 YuvDot(const int32 b, const int32 g, const int32 r,
+            const int16 (&coefficients)[4],
+            const int32 offset) noexcept {
+        const auto retval = (b * coefficients[0] + g * coefficients[1]
+            + r * coefficients[2] + (offset << YuvPrecision)
+            + (1 << (YuvPrecision - 1))) >> YuvPrecision;
+        return static_cast<uint8>((std::min)((std::max)(retval, 0), 255));
+    }
+
+} /* namespace */
+
+
+/*
+ * FDesktopImageKernels::ConvertToYuv420
+ */
+void FDesktopImageKernels::ConvertToYuv420(uint8 *y,
+        const uint32 yPitch,
+        uint8 *u,
+        uint8 *v,
+        const uint32 uvPitch,
+        const bool interleaved,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height,
+        const bool fullRange) noexcept {
+    const auto& c = YuvCoefficients[fullRange ? 1 : 0];
+    const auto& o = YuvOffsets[fullRange ? 1 : 0];
+    const auto step = interleaved ? 2 : 1;
+    if (interleaved) {
+        v = u + 1;
+    }
+
+    __m128i coefficients[3];
+    __m128i offsets[3];
+    for (uint32 i = 0; i < 3; ++i) {
+        coefficients[i] = _mm_setr_epi16(c[i][0], c[i][1], c[i][2], c[i][3],
+            c[i][0], c[i][1], c[i][2], c[i][3]);
+        offsets[i] = _mm_set1_epi32((o[i] << YuvPrecision)
+            + (1 << (YuvPrecision - 1)));
+    }
+
+    for (uint32 row = 0; row < height; row += 2) {
+        // An odd last row is paired with itself.
+        const auto last = (row + 1 >= height);
+        const auto s0 = src + row * srcPitch;
+        const auto s1 = last ? s0 : s0 + srcPitch;
+        const auto y0 = y + row * yPitch;
+        const auto y1 = last ? y0 : y0 + yPitch;
+        const auto cb = u + (row / 2) * uvPitch;
+        const auto cr = v + (row / 2) * uvPitch;
+        uint32 x = 0;
+
+        for (; x + 16 <= width; x += 16) {
+            __m128i a[4], b[4];
+            for (uint32 i = 0; i < 4; ++i) {
+                a[i] = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s0 + 4 * x + 16 * i));
+                b[i] = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i *>(s1 + 4 * x + 16 * i));
+            }
+
+            // Luma is computed for each of the 16 pixels in both rows.
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(y1 + x),
+                _mm_packus_epi16(
+                    _mm_packs_epi32(YuvDot(b[0], coefficients[0], offsets[0]),
+                        YuvDot(b[1], coefficients[0], offsets[0])),
+                    _mm_packs_epi32(YuvDot(b[2], coefficients[0], offsets[0]),
+                        YuvDot(b[3], coefficients[0], offsets[0]))));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(y0 + x),
+                _mm_packus_epi16(
+                    _mm_packs_epi32(YuvDot(a[0], coefficients[0], offsets[0]),
+                        YuvDot(a[1], coefficients[0], offsets[0])),
+                    _mm_packs_epi32(YuvDot(a[2], coefficients[0], offsets[0]),
+                        YuvDot(a[3], coefficients[0], offsets[0]))));
+
+            // Chroma is computed from the 2x2 averages, which we obtain by
+            // averaging the rows and then the even and odd pixels.
+            __m128i m[2];
+            for (uint32 i = 0; i < 2; ++i) {
+                const auto l = _mm_castsi128_ps(_mm_avg_epu8(a[2 * i], b[2 * i]));
+                const auto h = _mm_castsi128_ps(_mm_avg_epu8(a[2 * i + 1],
+                    b[2 * i + 1]));
+                m[i] = _mm_avg_epu8(
+                    _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0))),
+                    _mm_castps_si128(_mm_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1))));
+            }
+
+            const auto u16 = _mm_packs_epi32(
+                YuvDot(m[0], coefficients[1], offsets[1]),
+                YuvDot(m[1], coefficients[1], offsets[1]));
+            const auto v16 = _mm_packs_epi32(
+                YuvDot(m[0], coefficients[2], offsets[2]),
+                YuvDot(m[1], coefficients[2], offsets[2]));
+
+            if (interleaved) {
+                _mm_storeu_si128(reinterpret_cast<__m128i *>(cb + x),
+                    _mm_packus_epi16(_mm_unpacklo_epi16(u16, v16),
+                        _mm_unpackhi_epi16(u16, v16)));
+            } else {
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(cb + x / 2),
+                    _mm_packus_epi16(u16, u16));
+                _mm_storel_epi64(reinterpret_cast<__m128i *>(cr + x / 2),
+                    _mm_packus_epi16(v16, v16));
+            }
+        }
+
+        for (; x < width; x += 2) {
+            // An odd last column is paired with itself.
+            const auto x1 = (x + 1 < width) ? x + 1 : x;
+            const uint8 *p[] = {
+                s0 + 4 * x, s0 + 4 * x1, s1 + 4 * x, s1 + 4 * x1
+            };
+
+            y0[x] = YuvDot(p[0][0], p[0][1], p[0][2], c[0], o[0]);
+            y0[x1] = YuvDot(p[1][0], p[1][1], p[1][2], c[0], o[0]);
+            y1[x] = YuvDot(p[2][0], p[2][1], p[2][2], c[0], o[0]);
+            y1[x1] = YuvDot(p[3][0], p[3][1], p[3][2], c[0], o[0]);
+
+            int32 avg[3];
+            for (uint32 i = 0; i < 3; ++i) {
+                avg[i] = (p[0][i] + p[1][i] + p[2][i] + p[3][i] + 2) / 4;
+            }
+
+            cb[step * (x / 2)] = YuvDot(avg[0], avg[1], avg[2], c[1], o[1]);
+            cr[step * (x / 2)] = YuvDot(avg[0], avg[1], avg[2], c[2], o[2]);
+        }
+    }
+}
+
+
+/*
+ * FDesktopImageKernels::DownscaleHalf
+ */
+void FDesktopImageKernels::DownscaleHalf(uint8 *dst,
+        const uint32 dstPitch,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height) noexcept {
+    const auto dstWidth = width / 2;
+    const auto dstHeight = height / 2;
+
+    for (uint32 y = 0; y < dstHeight; ++y) {
+        auto d = dst + y * dstPitch;
+        auto s0 = src + 2 * y * srcPitch;
+        auto s1 = s0 + srcPitch;
+        uint32 x = 0;
+
+        // Process eight source pixels at once: average the two rows first and
+        // then the even and odd pixels of the result.
+        for (; x + 4 <= dstWidth; x += 4) {
+            const auto a = _mm_avg_epu8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(s0)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(s1)));
+            const auto b = _mm_avg_epu8(
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(s0 + 16)),
+                _mm_loadu_si128(reinterpret_cast<const __m128i *>(s1 + 16)));
+            const auto even = _mm_castps_si128(_mm_shuffle_ps(
+                _mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                _MM_SHUFFLE(2, 0, 2, 0)));
+            const auto odd = _mm_castps_si128(_mm_shuffle_ps(
+                _mm_castsi128_ps(a), _mm_castsi128_ps(b),
+                _MM_SHUFFLE(3, 1, 3, 1)));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(d),
+                _mm_avg_epu8(even, odd));
+            d += 16;
+            s0 += 32;
+            s1 += 32;
+        }
+
+        for (; x < dstWidth; ++x) {
+            for (uint32 c = 0; c < 4; ++c) {
+                d[c] = static_cast<uint8>((s0[c] + s0[c + 4]
+                    + s1[c] + s1[c + 4] + 2) / 4);
+            }
+            d += 4;
+            s0 += 8;
+            s1 += 8;
+        }
+    }
+}
+
+
+/*
+ * FDesktopImageKernels::Rotate
+ */
+void FDesktopImageKernels::Rotate(uint8 *dst,
+        const uint32 dstPitch,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height,
+        const int32 turns) noexcept {
+    switch (turns & 3) {
+        case 1:
+            // The source pixel (x, y) goes to (height - 1 - y, x), i.e. the
+            // columns of the source become the rows of the destination.
+            for (uint32 ty = 0; ty < height; ty += RotationTile) {
+                const auto th = (std::min)(RotationTile, height - ty);
+                for (uint32 tx = 0; tx < width; tx += RotationTile) {
+                    const auto tw = (std::min)(RotationTile, width - tx);
+                    const auto bottom = ty + (th & ~3u);
+                    const auto right = tx + (tw & ~3u);
+
+                    for (uint32 y = ty; y < bottom; y += 4) {
+                        auto s = src + y * srcPitch;
+                        for (uint32 x = tx; x < right; x += 4) {
+                            // Transposing the rows bottom-up yields the
+                            // columns in the order of the destination.
+                            __m128i r[4];
+                            for (uint32 i = 0; i < 4; ++i) {
+                                r[3 - i] = _mm_loadu_si128(
+                                    reinterpret_cast<const __m128i *>(
+                                        s + i * srcPitch + 4 * x));
+                            }
+                            Transpose(r);
+
+                            auto d = dst + x * dstPitch + 4 * (height - 4 - y);
+                            for (uint32 i = 0; i < 4; ++i) {
+                                _mm_storeu_si128(reinterpret_cast<__m128i *>(
+                                    d + i * dstPitch), r[i]);
+                            }
+                        }
+                    }
+
+                    for (uint32 y = ty; y < ty + th; ++y) {
+                        const auto x0 = (y < bottom) ? right : tx;
+                        for (uint32 x = x0; x < tx + tw; ++x) {
+                            CopyPixel(dst + x * dstPitch + 4 * (height - 1 - y),
+                                src + y * srcPitch + 4 * x);
+                        }
+                    }
+                }
+            }
+            break;
+
+        case 2:
+            // The source pixel (x, y) goes to (width - 1 - x, height - 1 - y),
+            // which preserves the rows, so no tiling is required.
+            for (uint32 y = 0; y < height; ++y) {
+                auto d = dst + (height - 1 - y) * dstPitch;
+                auto s = src + y * srcPitch;
+                uint32 x = 0;
+
+                for (; x + 4 <= width; x += 4) {
+                    const auto p = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i *>(s + 4 * x));
+                    _mm_storeu_si128(
+                        reinterpret_cast<__m128i *>(d + 4 * (width - 4 - x)),
+                        _mm_shuffle_epi32(p, _MM_SHUFFLE(0, 1, 2, 3)));
+                }
+
+                for (; x < width; ++x) {
+                    CopyPixel(d + 4 * (width - 1 - x), s + 4 * x);
+                }
+            }
+            break;
+
+        case 3:
+            // The source pixel (x, y) goes to (y, width - 1 - x).
+            for (uint32 ty = 0; ty < height; ty += RotationTile) {
+                const auto th = (std::min)(RotationTile, height - ty);
+                for (uint32 tx = 0; tx < width; tx += RotationTile) {
+                    const auto tw = (std::min)(RotationTile, width - tx);
+                    const auto bottom = ty + (th & ~3u);
+                    const auto right = tx + (tw & ~3u);
+
+                    for (uint32 y = ty; y < bottom; y += 4) {
+                        auto s = src + y * srcPitch;
+                        for (uint32 x = tx; x < right; x += 4) {
+                            __m128i r[4];
+                            for (uint32 i = 0; i < 4; ++i) {
+                                r[i] = _mm_loadu_si128(
+                                    reinterpret_cast<const __m128i *>(
+                                        s + i * srcPitch + 4 * x));
+                            }
+                            Transpose(r);
+
+                            auto d = dst + (width - 4 - x) * dstPitch + 4 * y;
+                            for (uint32 i = 0; i < 4; ++i) {
+                                _mm_storeu_si128(reinterpret_cast<__m128i *>(
+                                    d + (3 - i) * dstPitch), r[i]);
+                            }
+                        }
+                    }
+
+                    for (uint32 y = ty; y < ty + th; ++y) {
+                        const auto x0 = (y < bottom) ? right : tx;
+                        for (uint32 x = x0; x < tx + tw; ++x) {
+                            CopyPixel(dst + (width - 1 - x) * dstPitch + 4 * y,
+                                src + y * srcPitch + 4 * x);
+                        }
+                    }
+                }
+            }
+            break;
+
+        default:
+            for (uint32 y = 0; y < height; ++y) {
+                ::memcpy(dst + y * dstPitch, src + y * srcPitch, 4 * width);
+            }
+            break;
+    }
+}
+
+
+/*
+ * FDesktopImageKernels::RotateRegion
+ */
+FIntRect FDesktopImageKernels::RotateRegion(const FIntRect& region,
+        const int32 width,
+        const int32 height,
+        const int32 turns) noexcept {
+    switch (turns & 3) {
+        case 1:
+            return FIntRect(height - region.Max.Y, region.Min.X,
+                height - region.Min.Y, region.Max.X);
+
+        case 2:
+            return FIntRect(width - region.Max.X, height - region.Max.Y,
+                width - region.Min.X, height - region.Min.Y);
+
+        case 3:
+            return FIntRect(region.Min.Y, width - region.Max.X,
+                region.Max.Y, width - region.Min.X);
+
+        default:
+            return region;
+    }
+}
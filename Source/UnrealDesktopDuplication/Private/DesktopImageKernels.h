@@ -0,0 +1,128 @@
+// <copyright file="DesktopImageKernels.h" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/// <summary>
+/// Provides the CPU kernels for processing duplicated BGRA desktop images.
+/// </summary>
+/// <remarks>
+/// All kernels operate on 32-bit pixels and accept arbitrary row pitches in
+/// bytes, such that they can work directly on mapped staging textures.
+/// </remarks>
+class FDesktopImageKernels final {
+
+public:
+
+    /// <summary>
+    /// Converts an image to BT.709 YCbCr with 4:2:0 chroma subsampling.
+    /// </summary>
+    /// <remarks>
+    /// Each chroma sample is the average of a 2x2 block of pixels. If the
+    /// image has an odd width or height, the last column or row is
+    /// replicated for computing the chroma.
+    /// </remarks>
+    /// <param name="y">The luma plane.</param>
+    /// <param name="yPitch">The row pitch of the luma plane in bytes.</param>
+    /// <param name="u">The Cb plane or the interleaved CbCr plane.</param>
+    /// <param name="v">The Cr plane. This parameter is ignored if
+    /// <paramref name="interleaved" /> is set.</param>
+    /// <param name="uvPitch">The row pitch of the chroma plane(s) in bytes.
+    /// </param>
+    /// <param name="interleaved">If <see langword="true" />, Cb and Cr are
+    /// interleaved in <paramref name="u" /> as in NV12, otherwise they are
+    /// written to separate planes as in I420.</param>
+    /// <param name="src">The BGRA source image.</param>
+    /// <param name="srcPitch">The row pitch of <paramref name="src" /> in
+    /// bytes.</param>
+    /// <param name="width">The width of the source image in pixels.</param>
+    /// <param name="height">The height of the source image in pixels.</param>
+    /// <param name="fullRange">If <see langword="true" />, use the full range
+    /// of [0, 255] for all components instead of the limited range.</param>
+    static void ConvertToYuv420(uint8 *y,
+        const uint32 yPitch,
+        uint8 *u,
+        uint8 *v,
+        const uint32 uvPitch,
+        const bool interleaved,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height,
+        const bool fullRange) noexcept;
+
+    /// <summary>
+    /// Downscales an image to half its width and height using a 2x2 box
+    /// filter.
+    /// </summary>
+    /// <remarks>
+    /// If the source has an odd width or height, the last column or row is
+    /// ignored.
+    /// </remarks>
+    /// <param name="dst">The destination image, which must be able to hold
+    /// <c>(width / 2) x (height / 2)</c> pixels.</param>
+    /// <param name="dstPitch">The row pitch of <paramref name="dst" /> in
+    /// bytes.</param>
+    /// <param name="src">The source image.</param>
+    /// <param name="srcPitch">The row pitch of <paramref name="src" /> in
+    /// bytes.</param>
+    /// <param name="width">The width of the source image in pixels.</param>
+    /// <param name="height">The height of the source image in pixels.</param>
+    static void DownscaleHalf(uint8 *dst,
+        const uint32 dstPitch,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height) noexcept;
+
+    /// <summary>
+    /// Rotates an image clockwise by the given number of quarter turns.
+    /// </summary>
+    /// <remarks>
+    /// Quarter turns are implemented as SIMD transposes of 4x4 blocks, which
+    /// are processed in tiles such that neither the reads nor the writes
+    /// thrash the cache.
+    /// </remarks>
+    /// <param name="dst">The destination image, which must be able to hold
+    /// <c>height x width</c> pixels for an odd number of
+    /// <paramref name="turns" />.</param>
+    /// <param name="dstPitch">The row pitch of <paramref name="dst" /> in
+    /// bytes.</param>
+    /// <param name="src">The source image.</param>
+    /// <param name="srcPitch">The row pitch of <paramref name="src" /> in
+    /// bytes.</param>
+    /// <param name="width">The width of the source image in pixels.</param>
+    /// <param name="height">The height of the source image in pixels.</param>
+    /// <param name="turns">The number of clockwise quarter turns, which is
+    /// interpreted modulo four.</param>
+    static void Rotate(uint8 *dst,
+        const uint32 dstPitch,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height,
+        const int32 turns) noexcept;
+
+    /// <summary>
+    /// Computes where a region of an image ends up if the image is
+    /// <see cref="Rotate"/>d.
+    /// </summary>
+    /// <param name="region">The region in the source image.</param>
+    /// <param name="width">The width of the source image in pixels.</param>
+    /// <param name="height">The height of the source image in pixels.</param>
+    /// <param name="turns">The number of clockwise quarter turns, which is
+    /// interpreted modulo four.</param>
+    /// <returns>The region in the rotated image.</returns>
+    static FIntRect RotateRegion(const FIntRect& region,
+        const int32 width,
+        const int32 height,
+        const int32 turns) noexcept;
+
+    FDesktopImageKernels(void) = delete;
+};
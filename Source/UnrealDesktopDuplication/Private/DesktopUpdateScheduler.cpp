@@ -0,0 +1,224 @@
+// <copyright file="DesktopUpdateScheduler.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "DesktopUpdateScheduler.h"
+
+#include <algorithm>
+#include <limits>
+
+
+/*
+ * FDesktopUpdateScheduler::FDesktopUpdateScheduler
+ */
+FDesktopUpdateScheduler::FDesktopUpdateScheduler(const int32 tileSize) noexcept
+    : _columns(0),
+    _frame(0),
+    _height(0),
+    _maxLatency(1),
+    _peripheralInterval(1),
+    _radius(0),
+    _rows(0),
+    _tileSize((std::max)(tileSize, 1)),
+    _width(0) { }
+
+
+/*
+ * FDesktopUpdateScheduler::HasPending
+ */
+bool FDesktopUpdateScheduler::HasPending(void) const noexcept {
+    for (const auto age : this->_ages) {
+        if (age > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * FDesktopUpdateScheduler::Invalidate
+ */
+void FDesktopUpdateScheduler::Invalidate(void) noexcept {
+    // The maximum latency is clamped to the maximum age, so pretending that
+    // the tiles are as old as possible makes all of them due in the next
+    // frame.
+    for (auto& a : this->_ages) {
+        a = (std::numeric_limits<uint8>::max)();
+    }
+}
+
+
+/*
+ * FDesktopUpdateScheduler::MarkDirty
+ */
+void FDesktopUpdateScheduler::MarkDirty(const FIntRect& region) noexcept {
+    const auto left = (std::max)(region.Min.X, 0);
+    const auto top = (std::max)(region.Min.Y, 0);
+    const auto right = (std::min)(region.Max.X, this->_width);
+    const auto bottom = (std::min)(region.Max.Y, this->_height);
+
+    if ((left >= right) || (top >= bottom)) {
+        return;
+    }
+
+    for (int32 y = top / this->_tileSize;
+            y <= (bottom - 1) / this->_tileSize; ++y) {
+        for (int32 x = left / this->_tileSize;
+                x <= (right - 1) / this->_tileSize; ++x) {
+            // Tiles that are already dirty keep their age, because the
+            // latency guarantee refers to the first change.
+            auto& age = this->_ages[y * this->_columns + x];
+            if (age == 0) {
+                age = 1;
+            }
+        }
+    }
+}
+
+
+/*
+ * FDesktopUpdateScheduler::Resize
+ */
+void FDesktopUpdateScheduler::Resize(const int32 width,
+        const int32 height) noexcept {
+    if ((this->_width == width) && (this->_height == height)) {
+        return;
+    }
+
+    this->_width = (std::max)(width, 0);
+    this->_height = (std::max)(height, 0);
+    this->_columns = (this->_width + this->_tileSize - 1) / this->_tileSize;
+    this->_rows = (this->_height + this->_tileSize - 1) / this->_tileSize;
+    this->_ages.SetNumUninitialized(this->_columns * this->_rows);
+    this->Invalidate();
+}
+
+
+/*
+ * FDesktopUpdateScheduler::Schedule
+ */
+void FDesktopUpdateScheduler::Schedule(TArray<FIntRect>& regions,
+        const int32 granularity) noexcept {
+    regions.Reset();
+    ++this->_frame;
+
+    const auto batch = ((this->_frame % this->_peripheralInterval) == 0);
+    const auto g = (std::max)(granularity, 1);
+    const auto cell = g * this->_tileSize;
+    const auto columns = (this->_columns + g - 1) / g;
+    const auto rows = (this->_rows + g - 1) / g;
+
+    // Find out which cells contain a due tile and age all the others.
+    TArray<bool> due;
+    due.SetNumZeroed(columns * rows);
+
+    for (int32 y = 0; y < this->_rows; ++y) {
+        for (int32 x = 0; x < this->_columns; ++x) {
+            auto& age = this->_ages[y * this->_columns + x];
+            if (age == 0) {
+                continue;
+            }
+
+            if (batch
+                    || (age >= this->_maxLatency)
+                    || this->IsInFocus(x, y)) {
+                due[(y / g) * columns + x / g] = true;
+            } else if (age < (std::numeric_limits<uint8>::max)()) {
+                ++age;
+            }
+        }
+    }
+
+    // Clean all tiles in due cells, including the deferred ones, because the
+    // whole cell is uploaded anyway.
+    for (int32 y = 0; y < this->_rows; ++y) {
+        for (int32 x = 0; x < this->_columns; ++x) {
+            if (due[(y / g) * columns + x / g]) {
+                this->_ages[y * this->_columns + x] = 0;
+            }
+        }
+    }
+
+    // Coalesce runs of due cells in a row and merge them with identical runs
+    // in the row above.
+    for (int32 y = 0; y < rows; ++y) {
+        for (int32 x = 0; x < columns; ++x) {
+            if (!due[y * columns + x]) {
+                continue;
+            }
+
+            auto end = x + 1;
+            while ((end < columns) && due[y * columns + end]) {
+                ++end;
+            }
+
+            const FIntRect run(x * cell,
+                y * cell,
+                (std::min)(end * cell, this->_width),
+                (std::min)((y + 1) * cell, this->_height));
+
+            auto merged = regions.FindByPredicate([&run](const FIntRect& r) {
+                return (r.Min.X == run.Min.X)
+                    && (r.Max.X == run.Max.X)
+                    && (r.Max.Y == run.Min.Y);
+            });
+            if (merged != nullptr) {
+                merged->Max.Y = run.Max.Y;
+            } else {
+                regions.Add(run);
+            }
+
+            x = end;
+        }
+    }
+}
+
+
+/*
+ * FDesktopUpdateScheduler::SetFocus
+ */
+void FDesktopUpdateScheduler::SetFocus(const TArrayView<const FIntPoint> points,
+        const int32 radius) noexcept {
+    this->_focus = points;
+    this->_radius = (std::max)(radius, 0);
+}
+
+
+/*
+ * FDesktopUpdateScheduler::SetPeriphery
+ */
+void FDesktopUpdateScheduler::SetPeriphery(const int32 peripheralInterval,
+        const int32 maxLatency) noexcept {
+    this->_peripheralInterval = (std::max)(peripheralInterval, 1);
+    this->_maxLatency = (std::clamp)(maxLatency, 1,
+        static_cast<int32>((std::numeric_limits<uint8>::max)()));
+}
+
+
+/*
+ * FDesktopUpdateScheduler::IsInFocus
+ */
+bool FDesktopUpdateScheduler::IsInFocus(const int32 x,
+        const int32 y) const noexcept {
+    const auto left = x * this->_tileSize;
+    const auto top = y * this->_tileSize;
+    const auto right = left + this->_tileSize;
+    const auto bottom = top + this->_tileSize;
+    const auto r2 = static_cast<int64>(this->_radius) * this->_radius;
+
+    for (auto& p : this->_focus) {
+        // Compute the distance between the focus point and the closest point
+        // of the tile.
+        const int64 dx = (std::clamp)(p.X, left, right) - p.X;
+        const int64 dy = (std::clamp)(p.Y, top, bottom) - p.Y;
+        if (dx * dx + dy * dy <= r2) {
+            return true;
+        }
+    }
+
+    return false;
+}
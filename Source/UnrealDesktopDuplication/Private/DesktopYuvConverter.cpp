@@ -0,0 +1,167 @@
+// <copyright file="DesktopYuvConverter.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "DesktopYuvConverter.h"
+
+#include <algorithm>
+
+#include "Async/ParallelFor.h"
+#include "Misc/ScopeLock.h"
+
+#include "DesktopImageKernels.h"
+
+
+/*
+ * FDesktopYuvConverter::FDesktopYuvConverter
+ */
+FDesktopYuvConverter::FDesktopYuvConverter(void) noexcept : _frame { } { }
+
+
+/*
+ * FDesktopYuvConverter::Configure
+ */
+bool FDesktopYuvConverter::Configure(const uint32 width,
+        const uint32 height,
+        const EDesktopYuvFormat format,
+        const bool fullRange) noexcept {
+    FScopeLock l(&this->_lock);
+
+    const auto match = !this->_data.IsEmpty()
+        && (this->_frame.Width == width)
+        && (this->_frame.Height == height)
+        && (this->_frame.Format == format)
+        && (this->_frame.FullRange == fullRange);
+    if (match) {
+        return false;
+    }
+
+    const auto chromaWidth = (width + 1) / 2;
+    const auto chromaHeight = (height + 1) / 2;
+
+    this->_frame.Format = format;
+    this->_frame.FullRange = fullRange;
+    this->_frame.Height = height;
+    this->_frame.Width = width;
+    this->_frame.Pitches[0] = width;
+
+    if (format == EDesktopYuvFormat::NV12) {
+        this->_frame.PlaneCount = 2;
+        this->_frame.Pitches[1] = 2 * chromaWidth;
+        this->_frame.Pitches[2] = 0;
+    } else {
+        this->_frame.PlaneCount = 3;
+        this->_frame.Pitches[1] = chromaWidth;
+        this->_frame.Pitches[2] = chromaWidth;
+    }
+
+    const SIZE_T sizes[] = {
+        static_cast<SIZE_T>(this->_frame.Pitches[0]) * height,
+        static_cast<SIZE_T>(this->_frame.Pitches[1]) * chromaHeight,
+        static_cast<SIZE_T>(this->_frame.Pitches[2]) * chromaHeight
+    };
+    this->_data.SetNumZeroed(sizes[0] + sizes[1] + sizes[2]);
+
+    this->_frame.Planes[0] = this->_data.GetData();
+    this->_frame.Planes[1] = this->_frame.Planes[0] + sizes[0];
+    this->_frame.Planes[2] = (this->_frame.PlaneCount > 2)
+        ? this->_frame.Planes[1] + sizes[1]
+        : nullptr;
+
+    return true;
+}
+
+
+/*
+ * FDesktopYuvConverter::Convert
+ */
+void FDesktopYuvConverter::Convert(const uint8 *src,
+        const uint32 pitch,
+        const TArrayView<const FIntRect> regions) noexcept {
+    FScopeLock l(&this->_lock);
+    if (this->_data.IsEmpty()) {
+        return;
+    }
+
+    const auto width = static_cast<int32>(this->_frame.Width);
+    const auto height = static_cast<int32>(this->_frame.Height);
+    const auto interleaved = (this->_frame.Format == EDesktopYuvFormat::NV12);
+    const auto step = interleaved ? 2 : 1;
+    auto y = const_cast<uint8 *>(this->_frame.Planes[0]);
+    auto u = const_cast<uint8 *>(this->_frame.Planes[1]);
+    auto v = const_cast<uint8 *>(this->_frame.Planes[2]);
+
+    for (auto& r : regions) {
+        // Expand the region to whole macroblocks, which are the unit of the
+        // downstream encoders, and split it into rows of macroblocks that
+        // can be converted in parallel.
+        const auto left = (std::max)(r.Min.X, 0) & ~(MacroblockSize - 1);
+        const auto top = (std::max)(r.Min.Y, 0) & ~(MacroblockSize - 1);
+        const auto right = (std::min)(Align(r.Max.X, MacroblockSize), width);
+        const auto bottom = (std::min)(Align(r.Max.Y, MacroblockSize), height);
+        if ((left >= right) || (top >= bottom)) {
+            continue;
+        }
+
+        const auto rows = (bottom - top + MacroblockSize - 1) / MacroblockSize;
+        ParallelFor(rows, [&](const int32 i) {
+            const auto t = top + i * MacroblockSize;
+            const auto h = (std::min)(MacroblockSize, bottom - t);
+            const auto uvOffset = (t / 2) * this->_frame.Pitches[1]
+                + step * (left / 2);
+
+            FDesktopImageKernels::ConvertToYuv420(
+                y + t * this->_frame.Pitches[0] + left,
+                this->_frame.Pitches[0],
+                u + uvOffset,
+                interleaved ? nullptr : v + uvOffset,
+                this->_frame.Pitches[1],
+                interleaved,
+                src + t * pitch + 4 * left,
+                pitch,
+                right - left,
+                h,
+                this->_frame.FullRange);
+        });
+    }
+
+    ++this->_frame.Sequence;
+}
+
+
+/*
+ * FDesktopYuvConverter::GetAllocatedSize
+ */
+SIZE_T FDesktopYuvConverter::GetAllocatedSize(void) const noexcept {
+    FScopeLock l(&this->_lock);
+    return this->_data.GetAllocatedSize();
+}
+
+
+/*
+ * FDesktopYuvConverter::Read
+ */
+bool FDesktopYuvConverter::Read(
+        TFunctionRef<void(const FDesktopYuvFrame&)> reader) const {
+    FScopeLock l(&this->_lock);
+    const auto retval = !this->_data.IsEmpty()
+        && (this->_frame.Sequence > 0);
+
+    if (retval) {
+        reader(this->_frame);
+    }
+
+    return retval;
+}
+
+
+/*
+ * FDesktopYuvConverter::Release
+ */
+void FDesktopYuvConverter::Release(void) noexcept {
+    FScopeLock l(&this->_lock);
+    this->_data.Empty();
+    this->_frame = FDesktopYuvFrame { };
+}
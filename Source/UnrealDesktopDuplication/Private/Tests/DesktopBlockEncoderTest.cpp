@@ -0,0 +1,427 @@
+// <copyright file="DesktopBlockEncoderTest.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include <cmath>
+#include <cstring>
+
+#include "HAL/PlatformTime.h"
+
+#include "DesktopBlockEncoder.h"
+
+
+namespace {
+
+    /// <summary>
+    /// The kinds of synthetic desktop content the encoders are tested with.
+    /// </summary>
+    enum class EDesktopContent {
+        Flat,
+        Text,
+        Gradient
+    };
+
+    /// <summary>
+    /// Expands an RGB 5:6:5 colour to BGRA as specified by Direct3D.
+    /// </summary>
+    void Decode565(int32 (&bgra)[4], const uint16 colour) {
+        const auto r = (colour >> 11) & 0x1F;
+        const auto g = (colour >> 5) & 0x3F;
+        const auto b = colour & 0x1F;
+        bgra[0] = (b << 3) | (b >> 2);
+        bgra[1] = (g << 2) | (g >> 4);
+        bgra[2] = (r << 3) | (r >> 2);
+        bgra[3] = 255;
+    }
+
+    /// <summary>
+    /// Decodes a BC1 block into 4x4 BGRA pixels.
+    /// </summary>
+    void DecodeBC1(uint8 (&dst)[4 * 4 * 4], const uint8 *src) {
+        uint16 c0, c1;
+        uint32 indices;
+        ::memcpy(&c0, src, sizeof(c0));
+        ::memcpy(&c1, src + 2, sizeof(c1));
+        ::memcpy(&indices, src + 4, sizeof(indices));
+
+        int32 palette[4][4];
+        Decode565(palette[0], c0);
+        Decode565(palette[1], c1);
+        for (uint32 c = 0; c < 4; ++c) {
+            if (c0 > c1) {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            } else {
+                palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+                palette[3][c] = 0;
+            }
+        }
+
+        for (uint32 i = 0; i < 16; ++i) {
+            for (uint32 c = 0; c < 4; ++c) {
+                dst[4 * i + c] = static_cast<uint8>(
+                    palette[(indices >> (2 * i)) & 3][c]);
+            }
+        }
+    }
+
+    /// <summary>
+    /// Decodes a BC7 block into 4x4 BGRA pixels.
+    /// </summary>
+    /// <returns><see langword="false" /> if the block does not use mode 6,
+    /// which is the only one the encoder produces.</returns>
+    bool DecodeBC7(uint8 (&dst)[4 * 4 * 4], const uint8 *src) {
+        uint32 position = 0;
+        auto read = [src, &position](const uint32 count) {
+            uint32 retval = 0;
+            for (uint32 i = 0; i < count; ++i, ++position) {
+                retval |= ((src[position / 8] >> (position % 8)) & 1) << i;
+            }
+            return retval;
+        };
+
+        if (read(7) != (1 << 6)) {
+            return false;
+        }
+
+        // The endpoints are stored as RGBA whereas we produce BGRA.
+        static constexpr uint32 Channels[] = { 2, 1, 0, 3 };
+        static constexpr int32 Weights[] = { 0, 4, 9, 13, 17, 21, 26, 30, 34,
+            38, 43, 47, 51, 55, 60, 64 };
+
+        int32 endpoints[2][4];
+        for (auto c : Channels) {
+            endpoints[0][c] = read(7);
+            endpoints[1][c] = read(7);
+        }
+
+        const auto p0 = read(1);
+        const auto p1 = read(1);
+        for (uint32 c = 0; c < 4; ++c) {
+            endpoints[0][c] = (endpoints[0][c] << 1) | p0;
+            endpoints[1][c] = (endpoints[1][c] << 1) | p1;
+        }
+
+        for (uint32 i = 0; i < 16; ++i) {
+            const auto w = Weights[read((i == 0) ? 3 : 4)];
+            for (uint32 c = 0; c < 4; ++c) {
+                dst[4 * i + c] = static_cast<uint8>(((64 - w) * endpoints[0][c]
+                    + w * endpoints[1][c] + 32) >> 6);
+            }
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Fills a BGRA image with synthetic desktop content.
+    /// </summary>
+    void MakeDesktop(TArray<uint8>& dst,
+            const int32 width,
+            const int32 height,
+            const EDesktopContent content) {
+        FRandomStream random(42);
+        dst.SetNumUninitialized(4 * width * height);
+
+        auto set = [&dst, width](const int32 x, const int32 y,
+                const int32 b, const int32 g, const int32 r) {
+            auto p = dst.GetData() + 4 * (y * width + x);
+            p[0] = static_cast<uint8>(b);
+            p[1] = static_cast<uint8>(g);
+            p[2] = static_cast<uint8>(r);
+            p[3] = 255;
+        };
+
+        switch (content) {
+            case EDesktopContent::Flat:
+                // Windows with a title bar and a one-pixel frame on a
+                // uniform background. Blocks on the frames contain up to
+                // four colours, which do not lie on a line.
+                for (int32 y = 0; y < height; ++y) {
+                    for (int32 x = 0; x < width; ++x) {
+                        set(x, y, 120, 80, 30);
+                    }
+                }
+
+                for (int32 i = 0; i < 8; ++i) {
+                    const auto left = random.RandRange(0, width - 64);
+                    const auto top = random.RandRange(0, height - 48);
+                    const auto right = random.RandRange(left + 32, width);
+                    const auto bottom = random.RandRange(top + 32, height);
+                    const auto shade = random.RandRange(200, 250);
+                    for (int32 y = top; y < bottom; ++y) {
+                        for (int32 x = left; x < right; ++x) {
+                            const auto frame = (x == left) || (x == right - 1)
+                                || (y == top) || (y == bottom - 1);
+                            if (frame) {
+                                set(x, y, 90, 90, 90);
+                            } else if (y < top + 24) {
+                                set(x, y, 215, 160, 60);
+                            } else {
+                                set(x, y, shade, shade, shade);
+                            }
+                        }
+                    }
+                }
+                break;
+
+            case EDesktopContent::Text:
+                // Dark glyph-like strokes on a white page with one
+                // anti-aliased pixel on either side.
+                for (int32 y = 0; y < height; ++y) {
+                    for (int32 x = 0; x < width; ++x) {
+                        set(x, y, 255, 255, 255);
+                    }
+                }
+
+                for (int32 line = 4; line + 12 < height; line += 16) {
+                    for (int32 x = 4; x + 8 < width; x += 7) {
+                        if (random.RandRange(0, 5) == 0) {
+                            continue;
+                        }
+
+                        const auto stem = x + random.RandRange(0, 4);
+                        for (int32 y = line; y < line + 11; ++y) {
+                            set(stem - 1, y, 170, 170, 170);
+                            set(stem, y, 20, 20, 20);
+                            set(stem + 1, y, 170, 170, 170);
+                        }
+
+                        const auto bar = line + random.RandRange(0, 10);
+                        for (int32 xx = x; xx < x + 5; ++xx) {
+                            set(xx, bar, 20, 20, 20);
+                        }
+                    }
+                }
+                break;
+
+            case EDesktopContent::Gradient:
+                // Smooth colour ramps as in wallpapers in the upper half and
+                // short fades from blue to orange as in title bars and
+                // buttons in the lower one. The channels of the latter are
+                // anti-correlated, which the encoders must recognise.
+                for (int32 y = 0; y < height; ++y) {
+                    for (int32 x = 0; x < width; ++x) {
+                        const auto t = x % 32;
+                        if (y < height / 2) {
+                            set(x, y,
+                                255 * (height - 1 - y) / (height - 1),
+                                255 * (x + y) / (width + height - 2),
+                                255 * x / (width - 1));
+                        } else {
+                            set(x, y,
+                                255 - 255 * t / 31,
+                                64 + 96 * t / 31,
+                                255 * t / 31);
+                        }
+                    }
+                }
+                break;
+        }
+    }
+
+} /* namespace */
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopBlockEncoderQualityTest,
+    "UnrealDesktopDuplication.BlockEncoder.Quality",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopBlockEncoderQualityTest::RunTest
+ */
+bool FDesktopBlockEncoderQualityTest::RunTest(const FString& parameters) {
+    // The image is deliberately not a multiple of the block size such that
+    // the padding of the border blocks is exercised, too.
+    constexpr int32 width = 510;
+    constexpr int32 height = 318;
+
+    struct FCase {
+        EDesktopBlockCompression Compression;
+        EDesktopContent Content;
+        const TCHAR *Name;
+        double MinPsnr;
+    };
+
+    const FCase cases[] = {
+        { EDesktopBlockCompression::BC1, EDesktopContent::Flat,
+            TEXT("BC1 flat"), 31.0 },
+        { EDesktopBlockCompression::BC1, EDesktopContent::Text,
+            TEXT("BC1 text"), 30.0 },
+        { EDesktopBlockCompression::BC1, EDesktopContent::Gradient,
+            TEXT("BC1 gradient"), 38.0 },
+        { EDesktopBlockCompression::BC7, EDesktopContent::Flat,
+            TEXT("BC7 flat"), 33.0 },
+        { EDesktopBlockCompression::BC7, EDesktopContent::Text,
+            TEXT("BC7 text"), 37.0 },
+        { EDesktopBlockCompression::BC7, EDesktopContent::Gradient,
+            TEXT("BC7 gradient"), 46.0 }
+    };
+
+    TArray<uint8> blocks;
+    TArray<uint8> image;
+
+    for (auto& c : cases) {
+        MakeDesktop(image, width, height, c.Content);
+
+        const auto blockSize = FDesktopBlockEncoder::GetBlockSize(
+            c.Compression);
+        const auto columns = (width + 3) / 4;
+        const auto rows = (height + 3) / 4;
+        blocks.SetNumZeroed(columns * rows * blockSize);
+
+        FDesktopBlockEncoder::Encode(blocks.GetData(),
+            columns * blockSize,
+            image.GetData(),
+            4 * width,
+            width, height,
+            FIntRect(0, 0, width, height),
+            c.Compression);
+
+        // Compare the colour channels only, because the desktop is opaque
+        // and BC1 does not store alpha anyway.
+        double error = 0.0;
+        auto valid = true;
+        for (int32 by = 0; by < rows; ++by) {
+            for (int32 bx = 0; bx < columns; ++bx) {
+                const auto block = blocks.GetData()
+                    + (by * columns + bx) * blockSize;
+                uint8 decoded[4 * 4 * 4];
+                if (c.Compression == EDesktopBlockCompression::BC1) {
+                    DecodeBC1(decoded, block);
+                } else {
+                    valid &= DecodeBC7(decoded, block);
+                }
+
+                for (int32 y = 0; y < 4; ++y) {
+                    for (int32 x = 0; x < 4; ++x) {
+                        const auto ix = 4 * bx + x;
+                        const auto iy = 4 * by + y;
+                        if ((ix >= width) || (iy >= height)) {
+                            continue;
+                        }
+
+                        for (int32 ch = 0; ch < 3; ++ch) {
+                            const double d = decoded[4 * (4 * y + x) + ch]
+                                - image[4 * (iy * width + ix) + ch];
+                            error += d * d;
+                        }
+                    }
+                }
+            }
+        }
+
+        const auto mse = error / (3.0 * width * height);
+        const auto psnr = (mse > 0.0)
+            ? 10.0 * std::log10(255.0 * 255.0 / mse)
+            : 100.0;
+
+        this->TestTrue(FString::Printf(TEXT("%s uses BC7 mode 6 only"),
+            c.Name), valid);
+        this->AddInfo(FString::Printf(TEXT("%s: %.2f dB PSNR."), c.Name, psnr));
+        this->TestTrue(FString::Printf(TEXT("%s reaches at least %.1f dB ")
+            TEXT("PSNR"), c.Name, c.MinPsnr), psnr >= c.MinPsnr);
+    }
+
+    return true;
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopBlockEncoderThroughputTest,
+    "UnrealDesktopDuplication.BlockEncoder.Throughput",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopBlockEncoderThroughputTest::RunTest
+ */
+bool FDesktopBlockEncoderThroughputTest::RunTest(const FString& parameters) {
+    constexpr int32 width = 3840;
+    constexpr int32 height = 2160;
+    constexpr int32 repetitions = 4;
+
+    // Stack the three kinds of content on top of each other to get a mix
+    // that resembles a desktop.
+    TArray<uint8> image;
+    image.SetNumUninitialized(4 * width * height);
+    {
+        TArray<uint8> part;
+        const auto stride = 4 * width;
+        const EDesktopContent contents[] = { EDesktopContent::Flat,
+            EDesktopContent::Text, EDesktopContent::Gradient };
+        for (int32 i = 0; i < 3; ++i) {
+            const auto top = i * height / 3;
+            const auto bottom = (i + 1) * height / 3;
+            MakeDesktop(part, width, bottom - top, contents[i]);
+            ::memcpy(image.GetData() + top * stride, part.GetData(),
+                part.Num());
+        }
+    }
+
+    const EDesktopBlockCompression compressions[] = {
+        EDesktopBlockCompression::BC1,
+        EDesktopBlockCompression::BC7
+    };
+
+    TArray<uint8> blocks;
+    for (auto compression : compressions) {
+        const auto blockSize = FDesktopBlockEncoder::GetBlockSize(compression);
+        const auto columns = width / 4;
+        blocks.SetNumUninitialized(columns * (height / 4) * blockSize);
+
+        // Time the whole frame as the duplicator encodes it, which includes
+        // the distribution across the worker threads.
+        const auto start = FPlatformTime::Seconds();
+        for (int32 r = 0; r < repetitions; ++r) {
+            FDesktopBlockEncoder::Encode(blocks.GetData(),
+                columns * blockSize,
+                image.GetData(),
+                4 * width,
+                width, height,
+                FIntRect(0, 0, width, height),
+                compression);
+        }
+        const auto elapsed = (FPlatformTime::Seconds() - start) / repetitions;
+
+        // Time a single thread to make the numbers comparable across
+        // machines with a different number of cores.
+        const auto single = FPlatformTime::Seconds();
+        const auto encode = (compression == EDesktopBlockCompression::BC1)
+            ? &FDesktopBlockEncoder::EncodeBC1
+            : &FDesktopBlockEncoder::EncodeBC7;
+        for (int32 y = 0; y < height / 4; ++y) {
+            for (int32 x = 0; x < columns; ++x) {
+                encode(blocks.GetData() + (y * columns + x) * blockSize,
+                    image.GetData() + 4 * (4 * y * width + 4 * x),
+                    4 * width);
+            }
+        }
+        const auto elapsedSingle = FPlatformTime::Seconds() - single;
+
+        const auto pixels = static_cast<double>(width) * height;
+        this->AddInfo(FString::Printf(TEXT("%s at %d x %d: %.2f ms per ")
+            TEXT("frame (%.1f MPixel/s), %.2f ms on a single thread ")
+            TEXT("(%.1f MPixel/s)."),
+            (compression == EDesktopBlockCompression::BC1)
+                ? TEXT("BC1") : TEXT("BC7"),
+            width, height,
+            1000.0 * elapsed, pixels / elapsed / 1.0e6,
+            1000.0 * elapsedSingle, pixels / elapsedSingle / 1.0e6));
+        this->TestTrue(TEXT("Encoding takes a measurable amount of time"),
+            elapsed > 0.0);
+    }
+
+    return true;
+}
+
+#endif /* WITH_DEV_AUTOMATION_TESTS */
@@ -0,0 +1,208 @@
+// <copyright file="DesktopDuplicationGovernorTest.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include "DesktopDuplicationGovernor.h"
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopDuplicationGovernorSettleTest,
+    "UnrealDesktopDuplication.Governor.Settle",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopDuplicationGovernorTraceTest,
+    "UnrealDesktopDuplication.Governor.Trace",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopDuplicationGovernorSettleTest::RunTest
+ */
+bool FDesktopDuplicationGovernorSettleTest::RunTest(
+        const FString& parameters) {
+    constexpr float budget = 0.004f;
+    constexpr int32 degradeAfter = 8;
+    constexpr int32 recoverAfter = 60;
+    constexpr int32 opportunities = 16 * recoverAfter;
+
+    // Every capture costs the given multiple of the budget, and skipped
+    // opportunities cost nothing, which is what UDesktopDuplicator::Acquire
+    // reports to the governor.
+    struct {
+        float Load;
+        EDesktopDuplicationLoad Expected;
+    } const traces[] = {
+        { 0.5f, EDesktopDuplicationLoad::Unrestricted },
+        { 1.1f, EDesktopDuplicationLoad::ReducedRate },
+        { 1.5f, EDesktopDuplicationLoad::ReducedRate },
+        { 1.9f, EDesktopDuplicationLoad::ReducedRate },
+        { 3.0f, EDesktopDuplicationLoad::CoarseUpdates },
+        { 6.0f, EDesktopDuplicationLoad::HalfResolution }
+    };
+
+    for (auto& t : traces) {
+        FDesktopDuplicationGovernor governor(budget, degradeAfter,
+            recoverAfter);
+        auto level = governor.GetLevel();
+        int32 changes = 0;
+        int32 lastChange = -1;
+
+        for (int32 i = 0; i < opportunities; ++i) {
+            if (governor.ShouldCapture()) {
+                governor.Update(t.Load * budget);
+            }
+
+            if (governor.GetLevel() != level) {
+                level = governor.GetLevel();
+                lastChange = i;
+                ++changes;
+            }
+        }
+
+        this->TestEqual(FString::Printf(TEXT("%.1f times the budget settles ")
+            TEXT("at the expected level"), t.Load), level, t.Expected);
+        this->TestEqual(FString::Printf(TEXT("%.1f times the budget only ")
+            TEXT("degrades"), t.Load), changes, static_cast<int32>(level));
+        this->TestTrue(FString::Printf(TEXT("%.1f times the budget settles ")
+            TEXT("quickly"), t.Load), lastChange < opportunities / 4);
+    }
+
+    return true;
+}
+
+
+/*
+ * FDesktopDuplicationGovernorTraceTest::RunTest
+ */
+bool FDesktopDuplicationGovernorTraceTest::RunTest(const FString& parameters) {
+    constexpr float budget = 0.004f;
+    constexpr int32 degradeAfter = 8;
+    constexpr int32 recoverAfter = 60;
+    constexpr float headroom = 0.6f;
+    constexpr auto HalfResolution = EDesktopDuplicationLoad::HalfResolution;
+    constexpr auto Unrestricted = EDesktopDuplicationLoad::Unrestricted;
+
+    // Feeds a trace of constant frame times and records the indices of the
+    // samples at which the level changed.
+    auto replay = [](FDesktopDuplicationGovernor& governor,
+            const float frameTime,
+            const int32 samples,
+            TArray<int32>& changes) {
+        changes.Reset();
+        auto level = governor.GetLevel();
+        for (int32 i = 0; i < samples; ++i) {
+            const auto next = governor.Update(frameTime);
+            if (next != level) {
+                changes.Add(i);
+                level = next;
+            }
+        }
+    };
+
+    TArray<int32> changes;
+
+    {
+        FDesktopDuplicationGovernor governor(0.0f, degradeAfter, recoverAfter,
+            headroom);
+        replay(governor, 1.0f, 4 * degradeAfter, changes);
+        this->TestTrue(TEXT("Governor without budget never degrades"),
+            changes.IsEmpty() && (governor.GetLevel() == Unrestricted));
+        governor.Stall();
+        this->TestEqual(TEXT("Stall without budget does not degrade"),
+            governor.GetLevel(), Unrestricted);
+    }
+
+    FDesktopDuplicationGovernor governor(budget, degradeAfter, recoverAfter,
+        headroom);
+
+    // A sustained overload degrades one level every 'degradeAfter' samples,
+    // because the first sample initialises the average. The load must be
+    // high enough to exceed the budget even if only every fourth frame is
+    // captured.
+    replay(governor, 8.0f * budget, 4 * degradeAfter, changes);
+    this->TestEqual(TEXT("Overload degrades all three levels"),
+        changes.Num(), 3);
+    for (int32 i = 0; i < changes.Num(); ++i) {
+        this->TestEqual(TEXT("Overload degrades after degradeAfter samples"),
+            changes[i], (i + 1) * degradeAfter - 1);
+    }
+    this->TestEqual(TEXT("Overload ends at half resolution"),
+        governor.GetLevel(), HalfResolution);
+    this->TestTrue(TEXT("Half resolution is reported"),
+        governor.IsHalfResolution());
+
+    // The degraded levels skip frames according to their interval.
+    {
+        int32 captured = 0;
+        for (int32 i = 0; i < 4 * governor.GetFrameInterval(); ++i) {
+            captured += governor.ShouldCapture() ? 1 : 0;
+        }
+        this->TestEqual(TEXT("Half resolution captures every fourth frame"),
+            captured, 4);
+    }
+
+    // Frame times within the hysteresis band neither degrade nor recover,
+    // no matter how long they last. Every fourth frame is captured, so the
+    // time per opportunity is a quarter of the reported one.
+    replay(governor, 3.2f * budget, 8 * recoverAfter, changes);
+    this->TestTrue(TEXT("Hysteresis band keeps the level"), changes.IsEmpty());
+    this->TestEqual(TEXT("Hysteresis band stays at half resolution"),
+        governor.GetLevel(), HalfResolution);
+
+    // A short spike is absorbed by the smoothing.
+    {
+        FDesktopDuplicationGovernor spiky(budget, degradeAfter, recoverAfter,
+            headroom);
+        replay(spiky, 0.5f * budget, degradeAfter, changes);
+        spiky.Update(4.0f * budget);
+        replay(spiky, 0.5f * budget, degradeAfter, changes);
+        this->TestEqual(TEXT("Single spike does not degrade"),
+            spiky.GetLevel(), Unrestricted);
+    }
+
+    // A light load recovers one level every 'recoverAfter' samples once the
+    // average has dropped below the headroom.
+    replay(governor, 0.2f * budget, 4 * recoverAfter, changes);
+    this->TestEqual(TEXT("Light load recovers all three levels"),
+        changes.Num(), 3);
+    for (int32 i = 1; i < changes.Num(); ++i) {
+        this->TestEqual(TEXT("Light load recovers after recoverAfter samples"),
+            changes[i] - changes[i - 1], recoverAfter);
+    }
+    this->TestEqual(TEXT("Light load ends unrestricted"),
+        governor.GetLevel(), Unrestricted);
+
+    {
+        int32 captured = 0;
+        for (int32 i = 0; i < 8; ++i) {
+            captured += governor.ShouldCapture() ? 1 : 0;
+        }
+        this->TestEqual(TEXT("Unrestricted captures every frame"),
+            captured, 8);
+    }
+
+    // Stalls count as pressure even if no frame time is available.
+    for (int32 i = 0; i < degradeAfter; ++i) {
+        governor.Stall();
+    }
+    this->TestEqual(TEXT("Stalls degrade the level"), governor.GetLevel(),
+        EDesktopDuplicationLoad::ReducedRate);
+
+    // Changing the budget starts from scratch.
+    governor.SetBudget(2.0f * budget);
+    this->TestEqual(TEXT("New budget resets the level"), governor.GetLevel(),
+        Unrestricted);
+
+    return true;
+}
+
+#endif /* WITH_DEV_AUTOMATION_TESTS */
@@ -0,0 +1,589 @@
+// <copyright file="DesktopDuplicatorTest.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include <algorithm>
+
+#include "Windows/AllowWindowsPlatformTypes.h"
+#include <Windows.h>
+#include <d3d11.h>
+#include <dxgi1_2.h>
+#include "Windows/HideWindowsPlatformTypes.h"
+
+#include "HAL/Event.h"
+#include "HAL/PlatformProcess.h"
+
+#include "RenderingThread.h"
+
+#include "DesktopDuplicator.h"
+
+
+namespace {
+
+    /// <summary>
+    /// Creates a Direct3D 11 device on the hardware or, if there is none, on
+    /// the software rasteriser.
+    /// </summary>
+    ID3D11Device *CreateDevice(void) noexcept {
+        const D3D_DRIVER_TYPE types[] = {
+            D3D_DRIVER_TYPE_HARDWARE,
+            D3D_DRIVER_TYPE_WARP
+        };
+
+        for (auto type : types) {
+            ID3D11Device *retval = nullptr;
+            auto hr = ::D3D11CreateDevice(nullptr,
+                type,
+                NULL,
+                D3D11_CREATE_DEVICE_BGRA_SUPPORT,
+                nullptr, 0,
+                D3D11_SDK_VERSION,
+                &retval,
+                nullptr,
+                nullptr);
+            if (SUCCEEDED(hr)) {
+                return retval;
+            }
+        }
+
+        return nullptr;
+    }
+
+    /// <summary>
+    /// Answer whether the visible parts of the planes of two frames with
+    /// the same layout are equal.
+    /// </summary>
+    bool EqualPlanes(const FDesktopYuvFrame& lhs,
+            const FDesktopYuvFrame& rhs) {
+        if ((lhs.Format != rhs.Format)
+                || (lhs.Width != rhs.Width)
+                || (lhs.Height != rhs.Height)
+                || (lhs.PlaneCount != rhs.PlaneCount)) {
+            return false;
+        }
+
+        for (uint32 p = 0; p < lhs.PlaneCount; ++p) {
+            // NV12 interleaves both chroma samples in the second plane.
+            const auto chroma = (p > 0);
+            const auto width = chroma ? (lhs.Width + 1) / 2 : lhs.Width;
+            const auto height = chroma ? (lhs.Height + 1) / 2 : lhs.Height;
+            const auto bytes = ((lhs.Format == EDesktopYuvFormat::NV12)
+                && chroma) ? 2 * width : width;
+
+            for (uint32 y = 0; y < height; ++y) {
+                if (FMemory::Memcmp(lhs.Planes[p] + y * lhs.Pitches[p],
+                        rhs.Planes[p] + y * rhs.Pitches[p],
+                        bytes) != 0) {
+                    return false;
+                }
+            }
+        }
+
+        return true;
+    }
+
+    /// <summary>
+    /// Simulates the desktop duplication API on a desktop whose changes are
+    /// controlled by the test.
+    /// </summary>
+    /// <remarks>
+    /// Like DXGI, the simulation reports the regions that changed since the
+    /// last frame has been acquired, freezes the content of an acquired
+    /// frame and allows for holding only one frame at a time. Any call that
+    /// DXGI would reject is counted as a violation.
+    /// </remarks>
+    class FSimulatedDuplication final : public IDXGIOutputDuplication {
+
+    public:
+
+        FSimulatedDuplication(ID3D11Device *device,
+                const int32 width,
+                const int32 height) noexcept
+            : _accumulatedFrames(0),
+            _device(device),
+            _held(false),
+            _height(height),
+            _presentTime(0),
+            _references(1),
+            _violations(0),
+            _width(width) {
+            this->_device->AddRef();
+            this->_desktop.SetNumZeroed(width * height);
+            this->_accumulated.Add(FIntRect(0, 0, width, height));
+            this->_accumulatedFrames = 1;
+        }
+
+        FSimulatedDuplication(const FSimulatedDuplication&) = delete;
+
+        ~FSimulatedDuplication(void) noexcept {
+            this->_device->Release();
+        }
+
+        FSimulatedDuplication& operator =(
+            const FSimulatedDuplication&) = delete;
+
+        /// <summary>
+        /// Fills the given region of the desktop with the given colour.
+        /// </summary>
+        void Change(const FIntRect& region, const uint32 colour) noexcept {
+            for (int32 y = region.Min.Y; y < region.Max.Y; ++y) {
+                for (int32 x = region.Min.X; x < region.Max.X; ++x) {
+                    this->_desktop[y * this->_width + x] = colour;
+                }
+            }
+
+            this->_accumulated.Add(region);
+            ++this->_accumulatedFrames;
+        }
+
+        /// <summary>
+        /// Answer the current content of the desktop.
+        /// </summary>
+        inline const TArray<uint32>& GetDesktop(void) const noexcept {
+            return this->_desktop;
+        }
+
+        /// <summary>
+        /// Answer how many calls DXGI would have rejected.
+        /// </summary>
+        inline int32 GetViolations(void) const noexcept {
+            return this->_violations;
+        }
+
+        /// <summary>
+        /// Answer whether the desktop has not changed since the last frame
+        /// has been acquired.
+        /// </summary>
+        inline bool IsQuiet(void) const noexcept {
+            return this->_accumulated.IsEmpty();
+        }
+
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid,
+                void **object) override {
+            if (object == nullptr) {
+                return E_POINTER;
+            }
+
+            if ((riid == __uuidof(IUnknown))
+                    || (riid == __uuidof(IDXGIObject))
+                    || (riid == __uuidof(IDXGIOutputDuplication))) {
+                *object = static_cast<IDXGIOutputDuplication *>(this);
+                this->AddRef();
+                return S_OK;
+            }
+
+            *object = nullptr;
+            return E_NOINTERFACE;
+        }
+
+        ULONG STDMETHODCALLTYPE AddRef(void) override {
+            return ++this->_references;
+        }
+
+        ULONG STDMETHODCALLTYPE Release(void) override {
+            const auto retval = --this->_references;
+            if (retval == 0) {
+                delete this;
+            }
+            return retval;
+        }
+
+        HRESULT STDMETHODCALLTYPE SetPrivateData(REFGUID name,
+                UINT size,
+                const void *data) override {
+            return E_NOTIMPL;
+        }
+
+        HRESULT STDMETHODCALLTYPE SetPrivateDataInterface(REFGUID name,
+                const IUnknown *unknown) override {
+            return E_NOTIMPL;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetPrivateData(REFGUID name,
+                UINT *size,
+                void *data) override {
+            return E_NOTIMPL;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetParent(REFIID riid,
+                void **parent) override {
+            return E_NOTIMPL;
+        }
+
+        void STDMETHODCALLTYPE GetDesc(DXGI_OUTDUPL_DESC *desc) override {
+            *desc = DXGI_OUTDUPL_DESC { };
+            desc->ModeDesc.Width = this->_width;
+            desc->ModeDesc.Height = this->_height;
+            desc->ModeDesc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+            desc->Rotation = DXGI_MODE_ROTATION_IDENTITY;
+        }
+
+        HRESULT STDMETHODCALLTYPE AcquireNextFrame(UINT timeout,
+                DXGI_OUTDUPL_FRAME_INFO *info,
+                IDXGIResource **resource) override {
+            if ((info == nullptr) || (resource == nullptr)) {
+                return E_INVALIDARG;
+            }
+
+            *info = DXGI_OUTDUPL_FRAME_INFO { };
+            *resource = nullptr;
+
+            if (this->_held) {
+                ++this->_violations;
+                return DXGI_ERROR_INVALID_CALL;
+            }
+
+            // The simulation does not wait, because nothing can change the
+            // desktop while the test is blocked in here.
+            if (this->_accumulated.IsEmpty()) {
+                return DXGI_ERROR_WAIT_TIMEOUT;
+            }
+
+            // Every frame gets its own texture, because the content of a
+            // frame must not change for as long as it is held.
+            D3D11_TEXTURE2D_DESC desc { };
+            desc.Width = this->_width;
+            desc.Height = this->_height;
+            desc.MipLevels = 1;
+            desc.ArraySize = 1;
+            desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+            desc.SampleDesc.Count = 1;
+            desc.Usage = D3D11_USAGE_DEFAULT;
+
+            D3D11_SUBRESOURCE_DATA data { };
+            data.pSysMem = this->_desktop.GetData();
+            data.SysMemPitch = 4 * this->_width;
+
+            ID3D11Texture2D *texture = nullptr;
+            auto hr = this->_device->CreateTexture2D(&desc, &data, &texture);
+            if (SUCCEEDED(hr)) {
+                hr = texture->QueryInterface(resource);
+                texture->Release();
+            }
+            if (FAILED(hr)) {
+                return hr;
+            }
+
+            this->_dirty.Reset();
+            for (auto& r : this->_accumulated) {
+                this->_dirty.Add(RECT { r.Min.X, r.Min.Y, r.Max.X, r.Max.Y });
+            }
+            this->_accumulated.Reset();
+
+            info->AccumulatedFrames = this->_accumulatedFrames;
+            info->LastPresentTime.QuadPart = ++this->_presentTime;
+            info->TotalMetadataBufferSize = static_cast<UINT>(
+                this->_dirty.Num() * sizeof(RECT));
+            this->_accumulatedFrames = 0;
+            this->_held = true;
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetFrameDirtyRects(UINT size,
+                RECT *rects,
+                UINT *required) override {
+            if (required == nullptr) {
+                return E_INVALIDARG;
+            }
+            if (!this->_held) {
+                ++this->_violations;
+                return DXGI_ERROR_INVALID_CALL;
+            }
+
+            *required = static_cast<UINT>(this->_dirty.Num() * sizeof(RECT));
+            if (size < *required) {
+                return DXGI_ERROR_MORE_DATA;
+            }
+
+            FMemory::Memcpy(rects, this->_dirty.GetData(), *required);
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetFrameMoveRects(UINT size,
+                DXGI_OUTDUPL_MOVE_RECT *rects,
+                UINT *required) override {
+            if (required == nullptr) {
+                return E_INVALIDARG;
+            }
+            if (!this->_held) {
+                ++this->_violations;
+                return DXGI_ERROR_INVALID_CALL;
+            }
+
+            *required = 0;
+            return S_OK;
+        }
+
+        HRESULT STDMETHODCALLTYPE GetFramePointerShape(UINT size,
+                void *shape,
+                UINT *required,
+                DXGI_OUTDUPL_POINTER_SHAPE_INFO *info) override {
+            return DXGI_ERROR_NOT_FOUND;
+        }
+
+        HRESULT STDMETHODCALLTYPE MapDesktopSurface(
+                DXGI_MAPPED_RECT *rect) override {
+            return DXGI_ERROR_UNSUPPORTED;
+        }
+
+        HRESULT STDMETHODCALLTYPE UnMapDesktopSurface(void) override {
+            return DXGI_ERROR_UNSUPPORTED;
+        }
+
+        HRESULT STDMETHODCALLTYPE ReleaseFrame(void) override {
+            // Releasing without holding a frame is legal, but fails.
+            if (!this->_held) {
+                return DXGI_ERROR_INVALID_CALL;
+            }
+
+            this->_held = false;
+            return S_OK;
+        }
+
+    private:
+
+        TArray<FIntRect> _accumulated;
+        UINT _accumulatedFrames;
+        TArray<uint32> _desktop;
+        ID3D11Device *_device;
+        TArray<RECT> _dirty;
+        bool _held;
+        int32 _height;
+        LONGLONG _presentTime;
+        ULONG _references;
+        int32 _violations;
+        int32 _width;
+    };
+
+} /* namespace */
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopDuplicatorCoalescingTest,
+    "UnrealDesktopDuplication.Duplicator.Coalescing",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopDuplicatorIdleTrimTest,
+    "UnrealDesktopDuplication.Duplicator.IdleTrim",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopDuplicatorCoalescingTest::RunTest
+ */
+bool FDesktopDuplicatorCoalescingTest::RunTest(const FString& parameters) {
+    // This test feeds UDesktopDuplicator::Acquire with a simulated desktop
+    // and holds the render thread for a few frames every now and then, such
+    // that the duplicator must coalesce the frames acquired meanwhile. The
+    // YUV planes are converted from the content of the staging texture on
+    // the render thread, so they show whether stale content was uploaded.
+    constexpr int32 width = 200;
+    constexpr int32 height = 120;
+    constexpr int32 steps = 200;
+    constexpr int32 quiet = 8;
+
+    if (!GIsThreadedRendering) {
+        this->AddWarning(TEXT("Coalescing requires a rendering thread, which ")
+            TEXT("is not available."));
+        return true;
+    }
+
+    auto device = CreateDevice();
+    if (device == nullptr) {
+        this->AddWarning(TEXT("No Direct3D 11 device is available, so the ")
+            TEXT("coalescing cannot be tested."));
+        return true;
+    }
+
+    auto duplication = new FSimulatedDuplication(device, width, height);
+    auto duplicator = NewObject<UDesktopDuplicator>();
+    duplicator->FollowPointer = false;
+    duplicator->PeripheralInterval = 1;
+    duplicator->Target = NewObject<UTextureRenderTarget2D>();
+    duplicator->YuvFormat = EDesktopYuvFormat::NV12;
+
+    const auto attached = duplicator->Attach(duplication, device);
+    device->Release();
+    if (!this->TestTrue(TEXT("Simulated duplication attached"), attached)) {
+        duplication->Release();
+        return false;
+    }
+
+    // Answer whether the YUV planes of the duplicator show the simulated
+    // desktop as it is now.
+    auto upToDate = [&](void) {
+        FDesktopYuvConverter expected;
+        expected.Configure(width, height, EDesktopYuvFormat::NV12, false);
+        const FIntRect all(0, 0, width, height);
+        expected.Convert(
+            reinterpret_cast<const uint8 *>(duplication->GetDesktop().GetData()),
+            4 * width,
+            MakeArrayView(&all, 1));
+
+        auto retval = false;
+        expected.Read([&](const FDesktopYuvFrame& e) {
+            duplicator->ReadYuvFrame([&](const FDesktopYuvFrame& a) {
+                retval = EqualPlanes(e, a);
+            });
+        });
+        return retval;
+    };
+
+    FEvent *blocker = nullptr;
+    int32 blocked = 0;
+    int32 checked = 0;
+    auto consistent = true;
+    FRandomStream random(42);
+
+    for (int32 step = 0; step < steps + quiet; ++step) {
+        // Change the desktop for a while and let it become quiet then.
+        if ((step < steps) && (random.RandRange(0, 2) != 0)) {
+            const auto x = random.RandRange(0, width - 1);
+            const auto y = random.RandRange(0, height - 1);
+            const FIntRect r(x, y,
+                (std::min)(x + random.RandRange(1, 64), width),
+                (std::min)(y + random.RandRange(1, 48), height));
+            duplication->Change(r, random.GetUnsignedInt() | 0xFF000000);
+        }
+
+        // Hold the render thread such that the upload enqueued by the next
+        // acquisition cannot complete. The first frame is not held, because
+        // it creates the target, which must not wait for the render thread.
+        if ((blocker == nullptr)
+                && (step > 0)
+                && (step < steps)
+                && (random.RandRange(0, 3) == 0)) {
+            blocker = FPlatformProcess::GetSynchEventFromPool();
+            ENQUEUE_RENDER_COMMAND(BlockDesktopDuplicationTest)(
+                [blocker](FRHICommandListImmediate& cmdList) {
+                    blocker->Wait();
+                });
+            blocked = random.RandRange(1, 4);
+        }
+
+        const auto held = (blocker != nullptr);
+        duplicator->Acquire(0);
+
+        if (held) {
+            if (--blocked <= 0) {
+                blocker->Trigger();
+                FlushRenderingCommands();
+                FPlatformProcess::ReturnSynchEventToPool(blocker);
+                blocker = nullptr;
+            }
+
+        } else {
+            FlushRenderingCommands();
+
+            // If the acquisition was not blocked and no change is waiting in
+            // the simulation, nothing is outstanding in the duplicator.
+            if (duplication->IsQuiet()) {
+                consistent &= upToDate();
+                ++checked;
+            }
+        }
+    }
+
+    this->TestTrue(TEXT("Frames have been coalesced"),
+        duplicator->GetStatistics().CoalescedFrames > 0);
+    this->TestTrue(TEXT("Consistency has been checked"), checked > 0);
+    this->TestTrue(TEXT("Planes match the desktop whenever nothing is ")
+        TEXT("outstanding"), consistent);
+    this->TestTrue(TEXT("Planes match the desktop once it is quiet"),
+        upToDate());
+    this->TestEqual(TEXT("Duplicator obeys the DXGI protocol"),
+        duplication->GetViolations(), 0);
+
+    duplicator->Stop();
+    duplication->Release();
+    return true;
+}
+
+
+/*
+ * FDesktopDuplicatorIdleTrimTest::RunTest
+ */
+bool FDesktopDuplicatorIdleTrimTest::RunTest(const FString& parameters) {
+    constexpr int32 width = 256;
+    constexpr int32 height = 128;
+    constexpr int64 staging = 4 * width * height;
+    constexpr float timeout = 0.1f;
+
+    auto device = CreateDevice();
+    if (device == nullptr) {
+        this->AddWarning(TEXT("No Direct3D 11 device is available, so the ")
+            TEXT("idle trimming cannot be tested."));
+        return true;
+    }
+
+    auto duplication = new FSimulatedDuplication(device, width, height);
+    auto duplicator = NewObject<UDesktopDuplicator>();
+    duplicator->FollowPointer = false;
+    duplicator->IdleTimeout = timeout;
+    duplicator->PeripheralInterval = 1;
+    duplicator->Target = NewObject<UTextureRenderTarget2D>();
+
+    const auto attached = duplicator->Attach(duplication, device);
+    device->Release();
+    if (!this->TestTrue(TEXT("Simulated duplication attached"), attached)) {
+        duplication->Release();
+        return false;
+    }
+
+    // The first frame creates the staging texture and uploads the whole
+    // desktop, after which the desktop stays quiet.
+    this->TestTrue(TEXT("First frame is submitted"), duplicator->Acquire(0));
+    FlushRenderingCommands();
+
+    const auto active = duplicator->GetAllocatedSize();
+    this->TestTrue(TEXT("Active duplicator reports its staging texture"),
+        active >= staging);
+    this->TestTrue(TEXT("Total comprises active duplicator"),
+        UDesktopDuplicator::GetTotalAllocatedSize() >= active);
+
+    this->TestFalse(TEXT("Quiet desktop submits nothing"),
+        duplicator->Acquire(0));
+    this->TestEqual(TEXT("Memory retained before timeout"),
+        duplicator->GetAllocatedSize(), active);
+
+    FPlatformProcess::Sleep(2.0f * timeout);
+    this->TestFalse(TEXT("Timeout after idling submits nothing"),
+        duplicator->Acquire(0));
+    this->TestEqual(TEXT("Idle duplicator holds no memory"),
+        duplicator->GetAllocatedSize(), int64(0));
+
+    // The memory must stay at the same level for as long as the desktop
+    // does not change.
+    for (int32 i = 0; i < 16; ++i) {
+        this->TestFalse(TEXT("Idle duplicator submits nothing"),
+            duplicator->Acquire(0));
+        this->TestEqual(TEXT("Steady-state memory"),
+            duplicator->GetAllocatedSize(), int64(0));
+    }
+
+    // A change re-creates the staging resources.
+    duplication->Change(FIntRect(0, 0, 16, 16), 0xFFFFFFFF);
+    this->TestTrue(TEXT("Change after idling is submitted"),
+        duplicator->Acquire(0));
+    FlushRenderingCommands();
+    this->TestTrue(TEXT("Staging texture is re-created"),
+        duplicator->GetAllocatedSize() >= staging);
+
+    this->TestEqual(TEXT("Duplicator obeys the DXGI protocol"),
+        duplication->GetViolations(), 0);
+
+    duplicator->Stop();
+    duplication->Release();
+    return true;
+}
+
+#endif /* WITH_DEV_AUTOMATION_TESTS */
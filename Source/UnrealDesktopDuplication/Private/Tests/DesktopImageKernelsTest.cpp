@@ -0,0 +1,175 @@
+// <copyright file="DesktopImageKernelsTest.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include <algorithm>
+
+#include "DesktopImageKernels.h"
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopImageKernelsRotateTest,
+    "UnrealDesktopDuplication.ImageKernels.Rotate",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopImageKernelsRotateTest::RunTest
+ */
+bool FDesktopImageKernelsRotateTest::RunTest(const FString& parameters) {
+    // Sizes that are not multiples of the 4x4 blocks or the cache tiles
+    // exercise the scalar borders of the kernel.
+    const FIntPoint sizes[] = {
+        FIntPoint(1, 1),
+        FIntPoint(3, 5),
+        FIntPoint(7, 2),
+        FIntPoint(63, 65),
+        FIntPoint(67, 131),
+        FIntPoint(130, 64)
+    };
+    constexpr uint32 Sentinel = 0xDEADBEEF;
+
+    FRandomStream random(42);
+
+    // Computes where the pixel (x, y) of a width x height image ends up if
+    // it is rotated clockwise by the given number of quarter turns.
+    auto reference = [](const int32 x, const int32 y,
+            const int32 width, const int32 height,
+            const int32 turns) {
+        switch (turns & 3) {
+            case 1: return FIntPoint(height - 1 - y, x);
+            case 2: return FIntPoint(width - 1 - x, height - 1 - y);
+            case 3: return FIntPoint(y, width - 1 - x);
+            default: return FIntPoint(x, y);
+        }
+    };
+
+    for (auto& size : sizes) {
+        const auto width = size.X;
+        const auto height = size.Y;
+
+        // Use a padded pitch to make sure that the kernel honours it.
+        const auto srcStride = width + random.RandRange(0, 4);
+        TArray<uint32> src;
+        src.SetNumUninitialized(srcStride * height);
+        for (int32 i = 0; i < src.Num(); ++i) {
+            src[i] = static_cast<uint32>(i) * 2654435761u;
+        }
+
+        // Four turns must behave like none, because turns are modulo four.
+        for (int32 turns = 0; turns < 5; ++turns) {
+            const auto odd = ((turns & 1) != 0);
+            const auto dstWidth = odd ? height : width;
+            const auto dstHeight = odd ? width : height;
+            const auto dstStride = dstWidth + random.RandRange(0, 4);
+
+            TArray<uint32> expected;
+            expected.SetNumUninitialized(dstStride * dstHeight);
+            std::fill(expected.GetData(), expected.GetData() + expected.Num(),
+                Sentinel);
+
+            auto regionsMatch = true;
+            for (int32 y = 0; y < height; ++y) {
+                for (int32 x = 0; x < width; ++x) {
+                    const auto p = reference(x, y, width, height, turns);
+                    expected[p.Y * dstStride + p.X] = src[y * srcStride + x];
+
+                    const auto r = FDesktopImageKernels::RotateRegion(
+                        FIntRect(x, y, x + 1, y + 1), width, height, turns);
+                    regionsMatch &= (r.Min == p)
+                        && (r.Width() == 1)
+                        && (r.Height() == 1);
+                }
+            }
+
+            this->TestTrue(FString::Printf(TEXT("RotateRegion maps pixels of ")
+                TEXT("%d x %d by %d turns"), width, height, turns),
+                regionsMatch);
+
+            {
+                const FIntRect all(0, 0, width, height);
+                const auto r = FDesktopImageKernels::RotateRegion(all,
+                    width, height, turns);
+                this->TestTrue(FString::Printf(TEXT("RotateRegion maps the ")
+                    TEXT("whole %d x %d image by %d turns"), width, height,
+                    turns),
+                    r == FIntRect(0, 0, dstWidth, dstHeight));
+            }
+
+            TArray<uint32> actual;
+            actual.SetNumUninitialized(expected.Num());
+            std::fill(actual.GetData(), actual.GetData() + actual.Num(),
+                Sentinel);
+            FDesktopImageKernels::Rotate(
+                reinterpret_cast<uint8 *>(actual.GetData()),
+                4 * dstStride,
+                reinterpret_cast<const uint8 *>(src.GetData()),
+                4 * srcStride,
+                width, height,
+                turns);
+
+            this->TestTrue(FString::Printf(TEXT("Rotate %d x %d by %d turns ")
+                TEXT("matches the reference"), width, height, turns),
+                std::equal(actual.GetData(), actual.GetData() + actual.Num(),
+                    expected.GetData()));
+
+            // Rotate a random sub-rectangle of the rotated image in strips
+            // in the same way as the duplicator does and make sure that the
+            // strips end up exactly where the full rotation would put them.
+            const auto left = random.RandRange(0, dstWidth - 1);
+            const auto top = random.RandRange(0, dstHeight - 1);
+            const FIntRect region(left, top,
+                random.RandRange(left + 1, dstWidth),
+                random.RandRange(top + 1, dstHeight));
+            const auto s = FDesktopImageKernels::RotateRegion(region,
+                dstWidth, dstHeight, 4 - (turns & 3));
+            constexpr int32 stripHeight = 5;
+
+            std::fill(actual.GetData(), actual.GetData() + actual.Num(),
+                Sentinel);
+            for (int32 y = s.Min.Y; y < s.Max.Y; y += stripHeight) {
+                const FIntRect strip(s.Min.X, y,
+                    s.Max.X, (std::min)(y + stripHeight, s.Max.Y));
+                const auto d = FDesktopImageKernels::RotateRegion(strip,
+                    width, height, turns);
+                FDesktopImageKernels::Rotate(
+                    reinterpret_cast<uint8 *>(actual.GetData()
+                        + d.Min.Y * dstStride + d.Min.X),
+                    4 * dstStride,
+                    reinterpret_cast<const uint8 *>(src.GetData()
+                        + strip.Min.Y * srcStride + strip.Min.X),
+                    4 * srcStride,
+                    strip.Width(), strip.Height(),
+                    turns);
+            }
+
+            auto stripsMatch = true;
+            for (int32 y = 0; y < dstHeight; ++y) {
+                for (int32 x = 0; x < dstWidth; ++x) {
+                    const auto inside = (x >= region.Min.X)
+                        && (x < region.Max.X)
+                        && (y >= region.Min.Y)
+                        && (y < region.Max.Y);
+                    const auto i = y * dstStride + x;
+                    stripsMatch &= (actual[i] == (inside
+                        ? expected[i]
+                        : Sentinel));
+                }
+            }
+
+            this->TestTrue(FString::Printf(TEXT("Strips of %d x %d rotated ")
+                TEXT("by %d turns match the reference"), width, height,
+                turns), stripsMatch);
+        }
+    }
+
+    return true;
+}
+
+#endif /* WITH_DEV_AUTOMATION_TESTS */
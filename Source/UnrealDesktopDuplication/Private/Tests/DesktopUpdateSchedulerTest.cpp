@@ -0,0 +1,149 @@
+// <copyright file="DesktopUpdateSchedulerTest.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include <algorithm>
+
+#include "DesktopUpdateScheduler.h"
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopUpdateSchedulerLatencyTest,
+    "UnrealDesktopDuplication.Scheduler.Latency",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopUpdateSchedulerLatencyTest::RunTest
+ */
+bool FDesktopUpdateSchedulerLatencyTest::RunTest(const FString& parameters) {
+    constexpr int32 width = 640;
+    constexpr int32 height = 360;
+    constexpr int32 frames = 120;
+    constexpr int32 peripheralInterval = 10;
+    constexpr int32 maxLatency = 6;
+    constexpr int32 radius = 48;
+
+    FDesktopUpdateScheduler scheduler(32);
+    scheduler.SetPeriphery(peripheralInterval, maxLatency);
+    scheduler.Resize(width, height);
+
+    TArray<FIntRect> regions;
+
+    // A resize must make the whole surface due at once.
+    {
+        scheduler.Schedule(regions);
+        int64 area = 0;
+        for (auto& r : regions) {
+            area += static_cast<int64>(r.Width()) * r.Height();
+        }
+        this->TestEqual(TEXT("Resize uploads the whole surface"), area,
+            static_cast<int64>(width) * height);
+        this->TestFalse(TEXT("Nothing is pending after the initial upload"),
+            scheduler.HasPending());
+    }
+
+    TArray<FIntPoint> focus;
+    focus.Add(FIntPoint(100, 100));
+    scheduler.SetFocus(focus, radius);
+
+    // For every pixel, remember the frame in which it first became dirty
+    // after its last upload, or -1 if it is up to date.
+    TArray<int32> dirty;
+    dirty.SetNumUninitialized(width * height);
+    std::fill(dirty.GetData(), dirty.GetData() + dirty.Num(), -1);
+
+    bool focusDeferred = false;
+    int32 worst = 0;
+    FRandomStream random(42);
+
+    auto upload = [&](const int32 frame) {
+        for (auto& r : regions) {
+            for (int32 y = r.Min.Y; y < r.Max.Y; ++y) {
+                for (int32 x = r.Min.X; x < r.Max.X; ++x) {
+                    auto& d = dirty[y * width + x];
+                    if (d >= 0) {
+                        worst = (std::max)(worst, frame - d + 1);
+                        d = -1;
+                    }
+                }
+            }
+        }
+    };
+
+    for (int32 frame = 0; frame < frames; ++frame) {
+        // Simulate some random changes as well as one right at the focus,
+        // which must be uploaded immediately.
+        for (int32 i = 0; i < 3; ++i) {
+            const auto x = random.RandRange(0, width - 1);
+            const auto y = random.RandRange(0, height - 1);
+            const FIntRect region(x, y,
+                (std::min)(x + random.RandRange(1, 200), width),
+                (std::min)(y + random.RandRange(1, 100), height));
+            scheduler.MarkDirty(region);
+
+            for (int32 yy = region.Min.Y; yy < region.Max.Y; ++yy) {
+                for (int32 xx = region.Min.X; xx < region.Max.X; ++xx) {
+                    auto& d = dirty[yy * width + xx];
+                    if (d < 0) {
+                        d = frame;
+                    }
+                }
+            }
+        }
+
+        const FIntPoint& f = focus[0];
+        scheduler.MarkDirty(FIntRect(f.X, f.Y, f.X + 1, f.Y + 1));
+        if (dirty[f.Y * width + f.X] < 0) {
+            dirty[f.Y * width + f.X] = frame;
+        }
+
+        // Alternate the granularity as the governor would do.
+        scheduler.Schedule(regions, ((frame % 3) != 0) ? 1 : 4);
+        upload(frame);
+
+        focusDeferred |= (dirty[f.Y * width + f.X] >= 0);
+    }
+
+    this->TestTrue(TEXT("Dirty pixels are uploaded within the maximum ")
+        TEXT("latency"), worst <= maxLatency);
+    this->TestFalse(TEXT("Focus is uploaded in the frame it changed"),
+        focusDeferred);
+
+    // Once the source is quiet, the scheduler must converge within the
+    // maximum latency.
+    for (int32 frame = frames; frame < frames + maxLatency; ++frame) {
+        scheduler.Schedule(regions);
+        upload(frame);
+    }
+
+    this->TestFalse(TEXT("Nothing is pending after the maximum latency"),
+        scheduler.HasPending());
+    this->TestTrue(TEXT("All dirty pixels have been uploaded"),
+        std::all_of(dirty.GetData(), dirty.GetData() + dirty.Num(),
+            [](const int32 d) { return (d < 0); }));
+    this->TestTrue(TEXT("Dirty pixels are uploaded within the maximum ")
+        TEXT("latency after the source became quiet"), worst <= maxLatency);
+
+    // An invalidation makes everything due at once regardless of the focus.
+    scheduler.Invalidate();
+    scheduler.Schedule(regions);
+    {
+        int64 area = 0;
+        for (auto& r : regions) {
+            area += static_cast<int64>(r.Width()) * r.Height();
+        }
+        this->TestEqual(TEXT("Invalidation uploads the whole surface"), area,
+            static_cast<int64>(width) * height);
+    }
+
+    return true;
+}
+
+#endif /* WITH_DEV_AUTOMATION_TESTS */
@@ -0,0 +1,416 @@
+// <copyright file="DesktopYuvConverterTest.cpp" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+#include <algorithm>
+#include <cmath>
+
+#include "HAL/PlatformTime.h"
+
+#include "DesktopImageKernels.h"
+#include "DesktopYuvConverter.h"
+
+
+namespace {
+
+    /// <summary>
+    /// Fills a BGRA image with random pixels.
+    /// </summary>
+    void MakeImage(TArray<uint8>& dst,
+            const uint32 pitch,
+            const uint32 height,
+            FRandomStream& random) {
+        dst.SetNumUninitialized(pitch * height);
+        for (int32 i = 0; i < dst.Num(); ++i) {
+            dst[i] = static_cast<uint8>(random.RandRange(0, 255));
+        }
+    }
+
+    /// <summary>
+    /// Computes the BT.709 luma and chroma of a BGR colour in floating point.
+    /// </summary>
+    void ToYuv(double (&dst)[3],
+            const double b,
+            const double g,
+            const double r,
+            const bool fullRange) {
+        constexpr double Kb = 0.0722;
+        constexpr double Kr = 0.2126;
+        const auto luma = Kr * r + (1.0 - Kr - Kb) * g + Kb * b;
+        const auto yScale = fullRange ? 1.0 : 219.0 / 255.0;
+        const auto cScale = fullRange ? 1.0 : 224.0 / 255.0;
+        dst[0] = (fullRange ? 0.0 : 16.0) + yScale * luma;
+        dst[1] = 128.0 + cScale * (b - luma) / (2.0 * (1.0 - Kb));
+        dst[2] = 128.0 + cScale * (r - luma) / (2.0 * (1.0 - Kr));
+
+        for (auto& d : dst) {
+            d = (std::clamp)(d, 0.0, 255.0);
+        }
+    }
+
+} /* namespace */
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopYuvConverterKernelTest,
+    "UnrealDesktopDuplication.YuvConverter.Kernel",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopYuvConverterKernelTest::RunTest
+ */
+bool FDesktopYuvConverterKernelTest::RunTest(const FString& parameters) {
+    // The widths cover the SIMD path, its scalar tail and odd columns; the
+    // heights cover odd rows, which are paired with themselves.
+    const FIntPoint sizes[] = {
+        FIntPoint(1, 1),
+        FIntPoint(15, 3),
+        FIntPoint(16, 2),
+        FIntPoint(37, 21),
+        FIntPoint(130, 67)
+    };
+
+    FRandomStream random(42);
+    TArray<uint8> image;
+    TArray<uint8> yPlane;
+    TArray<uint8> uPlane;
+    TArray<uint8> vPlane;
+
+    for (auto& size : sizes) {
+        const auto width = static_cast<uint32>(size.X);
+        const auto height = static_cast<uint32>(size.Y);
+        const auto chromaWidth = (width + 1) / 2;
+        const auto chromaHeight = (height + 1) / 2;
+        const auto srcPitch = 4 * width + 4 * random.RandRange(0, 3);
+        MakeImage(image, srcPitch, height, random);
+
+        for (int32 mode = 0; mode < 4; ++mode) {
+            const auto interleaved = ((mode & 1) != 0);
+            const auto fullRange = ((mode & 2) != 0);
+            const auto step = interleaved ? 2u : 1u;
+            const auto yPitch = width + random.RandRange(0, 5);
+            const auto uvPitch = step * chromaWidth + random.RandRange(0, 5);
+
+            yPlane.SetNumZeroed(yPitch * height);
+            uPlane.SetNumZeroed(uvPitch * chromaHeight);
+            vPlane.SetNumZeroed(uvPitch * chromaHeight);
+
+            FDesktopImageKernels::ConvertToYuv420(yPlane.GetData(), yPitch,
+                uPlane.GetData(), vPlane.GetData(), uvPitch,
+                interleaved,
+                image.GetData(), srcPitch,
+                width, height,
+                fullRange);
+
+            double lumaError = 0.0;
+            double chromaError = 0.0;
+
+            for (uint32 y = 0; y < height; ++y) {
+                for (uint32 x = 0; x < width; ++x) {
+                    const auto p = image.GetData() + y * srcPitch + 4 * x;
+                    double expected[3];
+                    ToYuv(expected, p[0], p[1], p[2], fullRange);
+                    lumaError = (std::max)(lumaError,
+                        std::abs(yPlane[y * yPitch + x] - expected[0]));
+                }
+            }
+
+            for (uint32 y = 0; y < chromaHeight; ++y) {
+                for (uint32 x = 0; x < chromaWidth; ++x) {
+                    // Average the 2x2 block in floating point, replicating
+                    // the last row and column of odd images.
+                    const uint32 xs[] = { 2 * x, (std::min)(2 * x + 1,
+                        width - 1) };
+                    const uint32 ys[] = { 2 * y, (std::min)(2 * y + 1,
+                        height - 1) };
+                    double bgr[3] = { 0.0, 0.0, 0.0 };
+                    for (auto sy : ys) {
+                        for (auto sx : xs) {
+                            const auto p = image.GetData() + sy * srcPitch
+                                + 4 * sx;
+                            for (uint32 c = 0; c < 3; ++c) {
+                                bgr[c] += 0.25 * p[c];
+                            }
+                        }
+                    }
+
+                    double expected[3];
+                    ToYuv(expected, bgr[0], bgr[1], bgr[2], fullRange);
+
+                    const auto cb = uPlane[y * uvPitch + step * x];
+                    const auto cr = interleaved
+                        ? uPlane[y * uvPitch + step * x + 1]
+                        : vPlane[y * uvPitch + x];
+                    chromaError = (std::max)(chromaError,
+                        std::abs(cb - expected[1]));
+                    chromaError = (std::max)(chromaError,
+                        std::abs(cr - expected[2]));
+                }
+            }
+
+            // Luma is exact up to rounding and the error of the three 14-bit
+            // coefficients, which is at most 3 * 255 / 2^15 < 0.025. Chroma
+            // may be off by up to one, because the 2x2 average is rounded
+            // before the conversion.
+            const auto name = FString::Printf(TEXT("%u x %u %s %s range"),
+                width, height,
+                interleaved ? TEXT("NV12") : TEXT("I420"),
+                fullRange ? TEXT("full") : TEXT("limited"));
+            this->TestTrue(FString::Printf(TEXT("Luma of %s is within 0.5 ")
+                TEXT("of BT.709 (%.3f)"), *name, lumaError),
+                lumaError <= 0.525);
+            this->TestTrue(FString::Printf(TEXT("Chroma of %s is within 1 ")
+                TEXT("of BT.709 (%.3f)"), *name, chromaError),
+                chromaError <= 1.0 + 1e-3);
+
+            // Nothing must be written to the padding of the planes.
+            auto padding = true;
+            for (uint32 y = 0; y < height; ++y) {
+                for (auto x = width; x < yPitch; ++x) {
+                    padding &= (yPlane[y * yPitch + x] == 0);
+                }
+            }
+            for (uint32 y = 0; y < chromaHeight; ++y) {
+                for (auto x = step * chromaWidth; x < uvPitch; ++x) {
+                    padding &= (uPlane[y * uvPitch + x] == 0);
+                }
+            }
+            this->TestTrue(FString::Printf(TEXT("Padding of %s is retained"),
+                *name), padding);
+        }
+    }
+
+    return true;
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopYuvConverterLayoutTest,
+    "UnrealDesktopDuplication.YuvConverter.Layout",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopYuvConverterLayoutTest::RunTest
+ */
+bool FDesktopYuvConverterLayoutTest::RunTest(const FString& parameters) {
+    constexpr uint32 width = 75;
+    constexpr uint32 height = 41;
+    constexpr uint32 chromaWidth = (width + 1) / 2;
+    constexpr uint32 chromaHeight = (height + 1) / 2;
+
+    FRandomStream random(42);
+    TArray<uint8> before;
+    TArray<uint8> after;
+    MakeImage(before, 4 * width, height, random);
+    MakeImage(after, 4 * width, height, random);
+
+    // The macroblock-aligned region is converted from 'after', everything
+    // else retains the conversion of 'before'. The changed region touches
+    // the ragged right and bottom macroblocks.
+    const FIntRect changed(50, 30, 67, 33);
+    const FIntRect expected(48, 16, width, height);
+
+    const EDesktopYuvFormat formats[] = {
+        EDesktopYuvFormat::NV12,
+        EDesktopYuvFormat::I420
+    };
+
+    for (auto format : formats) {
+        const auto interleaved = (format == EDesktopYuvFormat::NV12);
+        const auto name = interleaved ? TEXT("NV12") : TEXT("I420");
+
+        FDesktopYuvConverter converter;
+        this->TestFalse(FString::Printf(TEXT("%s cannot be read before ")
+            TEXT("being converted"), name),
+            converter.Read([](const FDesktopYuvFrame&) { }));
+        this->TestTrue(FString::Printf(TEXT("%s is allocated initially"),
+            name), converter.Configure(width, height, format, false));
+        this->TestFalse(FString::Printf(TEXT("%s is not reallocated for the ")
+            TEXT("same configuration"), name),
+            converter.Configure(width, height, format, false));
+
+        TArray<FIntRect> regions;
+        regions.Add(FIntRect(0, 0, width, height));
+        converter.Convert(before.GetData(), 4 * width, regions);
+        regions.Reset();
+        regions.Add(changed);
+        converter.Convert(after.GetData(), 4 * width, regions);
+
+        // Compute the expected planes with the kernel, which has been
+        // checked against the reference before.
+        TArray<uint8> planes[2][3];
+        const TArray<uint8> *images[] = { &before, &after };
+        const auto uvPitch = interleaved ? 2 * chromaWidth : chromaWidth;
+        for (int32 i = 0; i < 2; ++i) {
+            planes[i][0].SetNumZeroed(width * height);
+            planes[i][1].SetNumZeroed(uvPitch * chromaHeight);
+            planes[i][2].SetNumZeroed(uvPitch * chromaHeight);
+            FDesktopImageKernels::ConvertToYuv420(planes[i][0].GetData(),
+                width,
+                planes[i][1].GetData(), planes[i][2].GetData(), uvPitch,
+                interleaved,
+                images[i]->GetData(), 4 * width,
+                width, height,
+                false);
+        }
+
+        const auto read = converter.Read([&](const FDesktopYuvFrame& frame) {
+            this->TestEqual(TEXT("Format is reported"), frame.Format, format);
+            this->TestFalse(TEXT("Range is reported"), frame.FullRange);
+            this->TestEqual(TEXT("Width is reported"), frame.Width, width);
+            this->TestEqual(TEXT("Height is reported"), frame.Height, height);
+            this->TestEqual(TEXT("Sequence counts conversions"),
+                frame.Sequence, static_cast<uint64>(2));
+            this->TestEqual(TEXT("Luma pitch is the width"),
+                frame.Pitches[0], width);
+
+            if (interleaved) {
+                this->TestEqual(TEXT("NV12 has two planes"),
+                    frame.PlaneCount, 2u);
+                this->TestEqual(TEXT("NV12 chroma pitch holds both samples"),
+                    frame.Pitches[1], 2 * chromaWidth);
+                this->TestTrue(TEXT("NV12 has no third plane"),
+                    frame.Planes[2] == nullptr);
+            } else {
+                this->TestEqual(TEXT("I420 has three planes"),
+                    frame.PlaneCount, 3u);
+                this->TestEqual(TEXT("I420 Cb pitch"), frame.Pitches[1],
+                    chromaWidth);
+                this->TestEqual(TEXT("I420 Cr pitch"), frame.Pitches[2],
+                    chromaWidth);
+                this->TestTrue(TEXT("I420 Cr follows Cb"), frame.Planes[2]
+                    == frame.Planes[1] + chromaWidth * chromaHeight);
+            }
+
+            this->TestTrue(TEXT("Chroma follows luma"),
+                frame.Planes[1] == frame.Planes[0] + width * height);
+
+            auto lumaMatches = true;
+            for (uint32 y = 0; y < height; ++y) {
+                for (uint32 x = 0; x < width; ++x) {
+                    const auto i = (expected.Contains(FIntPoint(x, y))) ? 1 : 0;
+                    lumaMatches &= (frame.Planes[0][y * width + x]
+                        == planes[i][0][y * width + x]);
+                }
+            }
+            this->TestTrue(FString::Printf(TEXT("%s luma is only updated in ")
+                TEXT("the touched macroblocks"), name), lumaMatches);
+
+            auto chromaMatches = true;
+            for (uint32 y = 0; y < chromaHeight; ++y) {
+                for (uint32 x = 0; x < chromaWidth; ++x) {
+                    const auto i = (expected.Contains(FIntPoint(2 * x, 2 * y)))
+                        ? 1 : 0;
+                    if (interleaved) {
+                        for (uint32 c = 0; c < 2; ++c) {
+                            const auto o = y * uvPitch + 2 * x + c;
+                            chromaMatches &= (frame.Planes[1][o]
+                                == planes[i][1][o]);
+                        }
+                    } else {
+                        const auto o = y * uvPitch + x;
+                        chromaMatches &= (frame.Planes[1][o]
+                            == planes[i][1][o]);
+                        chromaMatches &= (frame.Planes[2][o]
+                            == planes[i][2][o]);
+                    }
+                }
+            }
+            this->TestTrue(FString::Printf(TEXT("%s chroma is only updated ")
+                TEXT("in the touched macroblocks"), name), chromaMatches);
+        });
+        this->TestTrue(FString::Printf(TEXT("%s can be read"), name), read);
+
+        this->TestTrue(FString::Printf(TEXT("%s is reallocated for a ")
+            TEXT("different range"), name),
+            converter.Configure(width, height, format, true));
+        converter.Release();
+        this->TestEqual(FString::Printf(TEXT("%s releases its planes"), name),
+            converter.GetAllocatedSize(), static_cast<SIZE_T>(0));
+    }
+
+    return true;
+}
+
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(FDesktopYuvConverterThroughputTest,
+    "UnrealDesktopDuplication.YuvConverter.Throughput",
+    EAutomationTestFlags::EditorContext
+    | EAutomationTestFlags::ClientContext
+    | EAutomationTestFlags::ProductFilter)
+
+
+/*
+ * FDesktopYuvConverterThroughputTest::RunTest
+ */
+bool FDesktopYuvConverterThroughputTest::RunTest(const FString& parameters) {
+    constexpr uint32 width = 3840;
+    constexpr uint32 height = 2160;
+    constexpr int32 repetitions = 8;
+
+    FRandomStream random(42);
+    TArray<uint8> image;
+    MakeImage(image, 4 * width, height, random);
+
+    TArray<FIntRect> regions;
+    regions.Add(FIntRect(0, 0, width, height));
+
+    const EDesktopYuvFormat formats[] = {
+        EDesktopYuvFormat::NV12,
+        EDesktopYuvFormat::I420
+    };
+
+    for (auto format : formats) {
+        FDesktopYuvConverter converter;
+        converter.Configure(width, height, format, false);
+
+        // Time the whole frame as the duplicator converts it, which
+        // includes the distribution across the worker threads.
+        const auto start = FPlatformTime::Seconds();
+        for (int32 r = 0; r < repetitions; ++r) {
+            converter.Convert(image.GetData(), 4 * width, regions);
+        }
+        const auto elapsed = (FPlatformTime::Seconds() - start) / repetitions;
+
+        // Time the kernel on a single thread to make the numbers comparable
+        // across machines with a different number of cores.
+        double single = 0.0;
+        converter.Read([&](const FDesktopYuvFrame& frame) {
+            const auto interleaved = (format == EDesktopYuvFormat::NV12);
+            const auto kernelStart = FPlatformTime::Seconds();
+            FDesktopImageKernels::ConvertToYuv420(
+                const_cast<uint8 *>(frame.Planes[0]), frame.Pitches[0],
+                const_cast<uint8 *>(frame.Planes[1]),
+                const_cast<uint8 *>(frame.Planes[2]), frame.Pitches[1],
+                interleaved,
+                image.GetData(), 4 * width,
+                width, height,
+                frame.FullRange);
+            single = FPlatformTime::Seconds() - kernelStart;
+        });
+
+        const auto pixels = static_cast<double>(width) * height;
+        this->AddInfo(FString::Printf(TEXT("%s at %u x %u: %.2f ms per ")
+            TEXT("frame (%.1f MPixel/s), %.2f ms on a single thread ")
+            TEXT("(%.1f MPixel/s)."),
+            (format == EDesktopYuvFormat::NV12) ? TEXT("NV12") : TEXT("I420"),
+            width, height,
+            1000.0 * elapsed, pixels / elapsed / 1.0e6,
+            1000.0 * single, pixels / single / 1.0e6));
+        this->TestTrue(TEXT("Conversion takes a measurable amount of time"),
+            elapsed > 0.0);
+    }
+
+    return true;
+}
+
+#endif /* WITH_DEV_AUTOMATION_TESTS */
@@ -0,0 +1,117 @@
+// <copyright file="DesktopBlockEncoder.h" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "PixelFormat.h"
+
+#include "DesktopBlockEncoder.generated.h"
+
+
+/// <summary>
+/// Identifies the block compression applied to the duplicated desktop.
+/// </summary>
+UENUM(BlueprintType)
+enum class EDesktopBlockCompression : uint8 {
+    /// <summary>
+    /// The desktop is uploaded uncompressed.
+    /// </summary>
+    None,
+
+    /// <summary>
+    /// The desktop is uploaded as BC1 (DXT1) with four bits per pixel.
+    /// </summary>
+    BC1,
+
+    /// <summary>
+    /// The desktop is uploaded as BC7 with eight bits per pixel.
+    /// </summary>
+    BC7
+};
+
+
+/// <summary>
+/// Encodes BGRA images into block-compressed textures on the CPU.
+/// </summary>
+/// <remarks>
+/// The encoders favour throughput over quality: BC1 uses the inset bounding
+/// box of each block as endpoints and BC7 uses mode 6 only. Both pick the
+/// diagonal of the box that follows the colours, but blocks with more than
+/// two distinct colours, like on window frames, lose the most.
+/// </remarks>
+class UNREALDESKTOPDUPLICATION_API FDesktopBlockEncoder final {
+
+public:
+
+    /// <summary>
+    /// Answer the size of a single 4x4 block in bytes.
+    /// </summary>
+    /// <param name="compression"></param>
+    /// <returns>The size of a block or zero if
+    /// <paramref name="compression" /> is
+    /// <see cref="EDesktopBlockCompression::None" />.</returns>
+    static uint32 GetBlockSize(
+        const EDesktopBlockCompression compression) noexcept;
+
+    /// <summary>
+    /// Answer the Unreal pixel format for the given compression.
+    /// </summary>
+    /// <param name="compression"></param>
+    /// <returns></returns>
+    static EPixelFormat GetPixelFormat(
+        const EDesktopBlockCompression compression) noexcept;
+
+    /// <summary>
+    /// Encodes all blocks touching the given region of an image.
+    /// </summary>
+    /// <remarks>
+    /// The block rows are distributed across the worker threads. Pixels
+    /// outside the image are replaced by the closest pixel on its border.
+    /// </remarks>
+    /// <param name="dst">The block image, which must be large enough to hold
+    /// the whole source image.</param>
+    /// <param name="dstPitch">The size of a row of blocks in bytes.</param>
+    /// <param name="src">The BGRA source image.</param>
+    /// <param name="srcPitch">The row pitch of the source image in bytes.
+    /// </param>
+    /// <param name="width">The width of the source image in pixels.</param>
+    /// <param name="height">The height of the source image in pixels.</param>
+    /// <param name="region">The region to be encoded in pixels.</param>
+    /// <param name="compression">The compression to be applied, which must
+    /// not be <see cref="EDesktopBlockCompression::None" />.</param>
+    static void Encode(uint8 *dst,
+        const uint32 dstPitch,
+        const uint8 *src,
+        const uint32 srcPitch,
+        const uint32 width,
+        const uint32 height,
+        const FIntRect& region,
+        const EDesktopBlockCompression compression) noexcept;
+
+    /// <summary>
+    /// Encodes a single 4x4 block as BC1.
+    /// </summary>
+    /// <param name="dst">Receives the 8 bytes of the block.</param>
+    /// <param name="src">The top-left BGRA pixel of the block.</param>
+    /// <param name="pitch">The row pitch of the source in bytes.</param>
+    static void EncodeBC1(uint8 *dst,
+        const uint8 *src,
+        const uint32 pitch) noexcept;
+
+    /// <summary>
+    /// Encodes a single 4x4 block as BC7 mode 6.
+    /// </summary>
+    /// <param name="dst">Receives the 16 bytes of the block.</param>
+    /// <param name="src">The top-left BGRA pixel of the block.</param>
+    /// <param name="pitch">The row pitch of the source in bytes.</param>
+    static void EncodeBC7(uint8 *dst,
+        const uint8 *src,
+        const uint32 pitch) noexcept;
+
+    FDesktopBlockEncoder(void) = delete;
+};
@@ -0,0 +1,193 @@
+// <copyright file="DesktopDuplicationGovernor.h" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "DesktopDuplicationGovernor.generated.h"
+
+
+/// <summary>
+/// Describes how far the desktop duplication has been degraded in order to
+/// stay within its frame budget.
+/// </summary>
+UENUM(BlueprintType)
+enum class EDesktopDuplicationLoad : uint8 {
+    /// <summary>
+    /// Every frame is captured at full resolution.
+    /// </summary>
+    Unrestricted,
+
+    /// <summary>
+    /// Only every second frame is captured.
+    /// </summary>
+    ReducedRate,
+
+    /// <summary>
+    /// Only every fourth frame is captured and changed tiles are uploaded in
+    /// coarser blocks.
+    /// </summary>
+    CoarseUpdates,
+
+    /// <summary>
+    /// Like <see cref="CoarseUpdates"/>, but the CPU path additionally
+    /// uploads the desktop at half its resolution.
+    /// </summary>
+    HalfResolution
+};
+
+
+/// <summary>
+/// Tracks the time a <see cref="UDesktopDuplicator"/> spends per frame and
+/// decides how much the capture must be degraded to stay within a budget.
+/// </summary>
+/// <remarks>
+/// The governor does not measure anything on its own, but is fed with the
+/// frame times by its owner. This allows for testing the policy with
+/// simulated timing traces.
+/// The frame times are amortised over the frames that are skipped on the
+/// current level, because skipping is what relieves the game thread. A load
+/// that is only slightly over budget therefore settles on a reduced rate
+/// instead of cycling through all levels.
+/// </remarks>
+class UNREALDESKTOPDUPLICATION_API FDesktopDuplicationGovernor final {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    /// <param name="budget">The time in milliseconds that may be spent per
+    /// frame. A value of zero or less disables the governor.</param>
+    /// <param name="degradeAfter">The number of consecutive frames over
+    /// budget before the capture is degraded by one level.</param>
+    /// <param name="recoverAfter">The number of consecutive frames within
+    /// the headroom before the capture is restored by one level.</param>
+    /// <param name="headroom">The fraction of the budget the average frame
+    /// time must fall below in order to recover.</param>
+    FDesktopDuplicationGovernor(const float budget = 0.0f,
+        const int32 degradeAfter = 8,
+        const int32 recoverAfter = 60,
+        const float headroom = 0.6f) noexcept;
+
+    /// <summary>
+    /// Answer the exponential moving average of the reported frame times
+    /// amortised over the frame interval in milliseconds.
+    /// </summary>
+    /// <returns></returns>
+    inline float GetAverage(void) const noexcept {
+        return this->_average;
+    }
+
+    /// <summary>
+    /// Answer the frame budget in milliseconds.
+    /// </summary>
+    /// <returns></returns>
+    inline float GetBudget(void) const noexcept {
+        return this->_budget;
+    }
+
+    /// <summary>
+    /// Answer how many calls to <see cref="ShouldCapture"/> are required for
+    /// one frame to be captured on the current level.
+    /// </summary>
+    /// <returns></returns>
+    int32 GetFrameInterval(void) const noexcept;
+
+    /// <summary>
+    /// Answer the current degradation level.
+    /// </summary>
+    /// <returns></returns>
+    inline EDesktopDuplicationLoad GetLevel(void) const noexcept {
+        return this->_level;
+    }
+
+    /// <summary>
+    /// Answer whether the uploaded frames should be downscaled to half their
+    /// resolution.
+    /// </summary>
+    /// <returns></returns>
+    inline bool IsHalfResolution(void) const noexcept {
+        return (this->_level == EDesktopDuplicationLoad::HalfResolution);
+    }
+
+    /// <summary>
+    /// Restores the unrestricted level and discards all timing history.
+    /// </summary>
+    void Reset(void) noexcept;
+
+    /// <summary>
+    /// Changes the frame budget.
+    /// </summary>
+    /// <remarks>
+    /// If the budget actually changes, the governor is
+    /// <see cref="Reset"/>.
+    /// </remarks>
+    /// <param name="budget">The time in milliseconds that may be spent per
+    /// frame. A value of zero or less disables the governor.</param>
+    void SetBudget(const float budget) noexcept;
+
+    /// <summary>
+    /// Answer whether the current frame should be captured or skipped.
+    /// </summary>
+    /// <remarks>
+    /// This method must be called once per opportunity to capture a frame.
+    /// </remarks>
+    /// <returns></returns>
+    bool ShouldCapture(void) noexcept;
+
+    /// <summary>
+    /// Reports that a frame could not be processed, because the previous one
+    /// was still in flight.
+    /// </summary>
+    /// <remarks>
+    /// A stall is counted as a frame that exceeded the budget.
+    /// </remarks>
+    /// <returns>The level after the stall has been accounted for.</returns>
+    EDesktopDuplicationLoad Stall(void) noexcept;
+
+    /// <summary>
+    /// Reports the time spent for processing a captured frame.
+    /// </summary>
+    /// <remarks>
+    /// The frame time is divided by the <see cref="GetFrameInterval"/> of the
+    /// current level. A level is only restored if the projected time on the
+    /// less restricted level falls below the headroom.
+    /// </remarks>
+    /// <param name="frameTime">The frame time in milliseconds.</param>
+    /// <returns>The level after the frame has been accounted for.</returns>
+    EDesktopDuplicationLoad Update(const float frameTime) noexcept;
+
+private:
+
+    /// <summary>
+    /// The weight of a new sample in the moving average.
+    /// </summary>
+    static constexpr float Smoothing = 0.2f;
+
+    /// <summary>
+    /// Answer how many opportunities to capture a frame make up one
+    /// captured frame on the given level.
+    /// </summary>
+    static int32 GetFrameInterval(const EDesktopDuplicationLoad level) noexcept;
+
+    /// <summary>
+    /// Accounts for a frame that exceeded the budget and degrades the level
+    /// if this happened often enough in a row.
+    /// </summary>
+    void Pressure(void) noexcept;
+
+    float _average;
+    float _budget;
+    int32 _countdown;
+    int32 _degradeAfter;
+    float _headroom;
+    EDesktopDuplicationLoad _level;
+    int32 _over;
+    int32 _recoverAfter;
+    int32 _under;
+};
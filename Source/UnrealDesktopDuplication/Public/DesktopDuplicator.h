@@ -8,14 +8,23 @@
 
 #include "CoreMinimal.h"
 
+#include "Engine/Texture2D.h"
 #include "Engine/TextureRenderTarget2D.h"
 
 #include "HAL/ThreadSafeBool.h"
 
+#include <atomic>
+
+#include "DesktopBlockEncoder.h"
+#include "DesktopDuplicationGovernor.h"
+#include "DesktopUpdateScheduler.h"
+#include "DesktopYuvConverter.h"
+
 #include "DesktopDuplicator.generated.h"
 
 
 // Forward declarations
+struct FDesktopDuplicationSession;
 class ID3D11Device;
 class ID3D11DeviceContext;
 class ID3D11Fence;
@@ -29,6 +38,35 @@ struct IUnknown;
 DECLARE_LOG_CATEGORY_EXTERN(DesktopDuplicatorLog, Log, All);
 
 
+/// <summary>
+/// Counts the frames processed by a <see cref="UDesktopDuplicator"/> since it
+/// has been created.
+/// </summary>
+USTRUCT(BlueprintType)
+struct UNREALDESKTOPDUPLICATION_API FDesktopDuplicationStatistics {
+    GENERATED_BODY()
+
+    /// <summary>
+    /// The number of frames acquired from the desktop duplication API.
+    /// </summary>
+    UPROPERTY(BlueprintReadOnly, Category = "Desktop duplication")
+    int64 AcquiredFrames = 0;
+
+    /// <summary>
+    /// The number of frames acquired while the previous frame was still being
+    /// processed, whose changes have therefore been merged into a later one.
+    /// </summary>
+    UPROPERTY(BlueprintReadOnly, Category = "Desktop duplication")
+    int64 CoalescedFrames = 0;
+
+    /// <summary>
+    /// The number of updates of the target that have been enqueued.
+    /// </summary>
+    UPROPERTY(BlueprintReadOnly, Category = "Desktop duplication")
+    int64 SubmittedFrames = 0;
+};
+
+
 /// <summary>
 /// Represents the duplication of a single output to a render target.
 /// </summary>
@@ -60,27 +98,193 @@ public:
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
     bool AllowGpuCopy;
 
+    /// <summary>
+    /// Receives the duplicated output instead of <see cref="Target"/> if
+    /// <see cref="Compression"/> is enabled.
+    /// </summary>
+    /// <remarks>
+    /// The texture is created by the duplicator. Its size is rounded up to
+    /// the next multiple of four.
+    /// </remarks>
+    UPROPERTY(BlueprintReadOnly, Transient, Category = "Desktop duplication")
+    UTexture2D *CompressedTarget;
+
+    /// <summary>
+    /// Specifies whether the changed regions are block-compressed on the CPU
+    /// and uploaded to <see cref="CompressedTarget"/>.
+    /// </summary>
+    /// <remarks>
+    /// Enabling the compression disables <see cref="AllowGpuCopy"/>.
+    /// </remarks>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
+    EDesktopBlockCompression Compression;
+
     /// <summary>
     /// Specifies the name of the display to be duplicated.
     /// </summary>
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
     FString DisplayName;
 
+    /// <summary>
+    /// Additional points on the desktop around which changes are uploaded at
+    /// full rate if <see cref="PeripheralInterval"/> defers the others.
+    /// </summary>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
+    TArray<FIntPoint> FocusPoints;
+
+    /// <summary>
+    /// The radius in pixels around the pointer and the
+    /// <see cref="FocusPoints"/> in which changes are uploaded at full rate.
+    /// </summary>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication", meta = (ClampMin = "0"))
+    int32 FocusRadius;
+
+    /// <summary>
+    /// Determines whether the mouse pointer is a focus point in addition to
+    /// the <see cref="FocusPoints"/>.
+    /// </summary>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
+    bool FollowPointer;
+
+    /// <summary>
+    /// The time in milliseconds the duplicator may spend per frame before the
+    /// capture is degraded. A value of zero disables the frame-budget
+    /// governor.
+    /// </summary>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication", meta = (ClampMin = "0", Units = "ms"))
+    float FrameBudget;
+
+    /// <summary>
+    /// The time in seconds without any change of the desktop after which the
+    /// staging resources are released until the desktop changes again. A
+    /// value of zero keeps the resources for as long as the duplicator is
+    /// running.
+    /// </summary>
+    /// <remarks>
+    /// The content of the targets is retained while the duplicator is idle.
+    /// </remarks>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication", meta = (ClampMin = "0", Units = "s"))
+    float IdleTimeout;
+
+    /// <summary>
+    /// The number of frames after which a changed region outside the focus is
+    /// uploaded at the latest.
+    /// </summary>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication", meta = (ClampMin = "1", ClampMax = "255"))
+    int32 MaxUpdateLatency;
+
+    /// <summary>
+    /// The interval in frames at which changed regions outside the focus are
+    /// uploaded. A value of one uploads all changes immediately.
+    /// </summary>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication", meta = (ClampMin = "1"))
+    int32 PeripheralInterval;
+
     /// <summary>
     /// The render target which receives the duplicated output.
     /// </summary>
     UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
     UTextureRenderTarget2D *Target;
 
+    /// <summary>
+    /// Specifies whether the duplicated desktop is additionally converted to
+    /// NV12 or I420, which can be obtained via <see cref="ReadYuvFrame"/>.
+    /// </summary>
+    /// <remarks>
+    /// The conversion requires the frames to pass through the CPU, so
+    /// enabling it disables <see cref="AllowGpuCopy"/>.
+    /// </remarks>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
+    EDesktopYuvFormat YuvFormat;
+
+    /// <summary>
+    /// Specifies whether the YUV conversion uses the full range of [0, 255]
+    /// instead of the limited (video) range.
+    /// </summary>
+    UPROPERTY(BlueprintReadWrite, EditAnywhere, Category = "Desktop duplication")
+    bool YuvFullRange;
+
     /// <summary>
     /// Tries to acquire a new frame to <see cref="Target"/>.
     /// </summary>
     /// <param name="timeout">The timeout for the acquisition in
-    /// milliseconds.</param>
+    /// milliseconds. A negative value waits until the desktop changes,
+    /// unless deferred tiles are pending, which are flushed without waiting
+    /// in this case.</param>
     /// <returns></returns>
     UFUNCTION(BlueprintCallable, Category = "Desktop duplication")
     bool Acquire(const int32 timeout) noexcept;
 
+    /// <summary>
+    /// Starts duplicating an output that has been duplicated elsewhere
+    /// instead of the display identified by <see cref="DisplayName"/>.
+    /// </summary>
+    /// <remarks>
+    /// This allows for sharing the duplication with other code or for
+    /// feeding the duplicator with a simulated desktop. The duplicator
+    /// acquires its own references to the given objects. The method must be
+    /// called on the game thread.
+    /// </remarks>
+    /// <param name="duplication">The duplication to acquire the frames
+    /// from.</param>
+    /// <param name="device">The device the <paramref name="duplication" />
+    /// has been created on.</param>
+    /// <returns><see langword="true" /> if the duplicator is running now.
+    /// </returns>
+    bool Attach(IDXGIOutputDuplication *duplication,
+        ID3D11Device *device) noexcept;
+
+    /// <summary>
+    /// Answer the memory held by the duplicator in bytes.
+    /// </summary>
+    /// <remarks>
+    /// This comprises the staging texture and all CPU-side buffers, but not
+    /// the targets, which are accounted for by the engine.
+    /// </remarks>
+    /// <returns></returns>
+    UFUNCTION(BlueprintPure, Category = "Desktop duplication")
+    int64 GetAllocatedSize(void) const noexcept;
+
+    /// <summary>
+    /// Answer how far the capture is currently degraded to stay within the
+    /// <see cref="FrameBudget"/>.
+    /// </summary>
+    /// <returns></returns>
+    UFUNCTION(BlueprintPure, Category = "Desktop duplication")
+    EDesktopDuplicationLoad GetLoad(void) const noexcept;
+
+    /// <inheritdoc />
+    virtual void GetResourceSizeEx(
+        FResourceSizeEx& cumulativeResourceSize) override;
+
+    /// <summary>
+    /// Answer how many frames have been acquired, coalesced and submitted.
+    /// </summary>
+    /// <returns></returns>
+    UFUNCTION(BlueprintPure, Category = "Desktop duplication")
+    FDesktopDuplicationStatistics GetStatistics(void) const noexcept;
+
+    /// <summary>
+    /// Answer the memory held by all existing duplicators in bytes.
+    /// </summary>
+    /// <returns></returns>
+    UFUNCTION(BlueprintPure, Category = "Desktop duplication")
+    static int64 GetTotalAllocatedSize(void) noexcept;
+
+    /// <summary>
+    /// Provides the given callback with direct access to the planes of the
+    /// desktop converted to <see cref="YuvFormat"/>.
+    /// </summary>
+    /// <remarks>
+    /// The planes are not copied and the duplicator will not update them
+    /// while the callback is running. This method can be called from any
+    /// thread.
+    /// </remarks>
+    /// <param name="reader"></param>
+    /// <returns><see langword="true" /> if a converted frame was available
+    /// and the <paramref name="reader" /> has been invoked.</returns>
+    bool ReadYuvFrame(TFunctionRef<void(const FDesktopYuvFrame&)> reader) const;
+
     /// <summary>
     /// Starts duplication the display identified by <see cref="DisplayName"/>.
     /// </summary>
@@ -88,14 +292,87 @@ public:
     UFUNCTION(BlueprintCallable, Category = "Desktop duplication")
     bool Start();
 
+    /// <summary>
+    /// Starts the given duplicators without blocking the game thread.
+    /// </summary>
+    /// <remarks>
+    /// The outputs are enumerated once for all duplicators on a background
+    /// thread and the devices are created in parallel. Only the duplicators
+    /// that are still alive once all devices have been created are started.
+    /// </remarks>
+    /// <param name="duplicators">The duplicators to be started. Entries that
+    /// are <see langword="nullptr" /> are reported as failed.</param>
+    /// <param name="onCompleted">A callback that is invoked on the game
+    /// thread once all duplicators have been processed. It receives whether
+    /// each of the <paramref name="duplicators" /> has been started.</param>
+    static void StartAsync(const TArray<UDesktopDuplicator *>& duplicators,
+        TFunction<void(const TArray<bool>&)> onCompleted);
+
     /// <summary>
     /// Releases all resource used for desktop duplication.
     /// </summary>
+    /// <remarks>
+    /// If an update of the target is still in flight, the method waits for
+    /// the render thread to complete it.
+    /// </remarks>
     UFUNCTION(BlueprintCallable, Category = "Desktop duplication")
     void Stop() noexcept;
 
 private:
 
+    /// <summary>
+    /// Takes over the objects of the given session if the duplicator is not
+    /// yet running.
+    /// </summary>
+    /// <remarks>
+    /// The method must be called on the game thread. The session is empty
+    /// afterwards, regardless of whether it has been attached or released.
+    /// </remarks>
+    /// <param name="session"></param>
+    /// <returns><see langword="true" /> if the duplicator is running now.
+    /// </returns>
+    bool Attach(FDesktopDuplicationSession& session) noexcept;
+
+    /// <summary>
+    /// Acquires the next frame without waiting while the previous one is
+    /// still being processed and merges its changed regions into the
+    /// <see cref="_scheduler"/>.
+    /// </summary>
+    /// <remarks>
+    /// <para>The staging texture still holds the previous frame, so a frame
+    /// with content is kept in <see cref="_coalesced"/> until the next call
+    /// to <see cref="Acquire"/> stages it. As long as such a frame is held,
+    /// the method does nothing, because DXGI accumulates all further changes
+    /// in the next frame anyway.</para>
+    /// <para>The method must be called on the game thread while the render
+    /// thread owns the busy flag.</para>
+    /// </remarks>
+    void Coalesce(void) noexcept;
+
+    /// <summary>
+    /// Retrieves the move and dirty regions of the frame acquired last and
+    /// marks them in the <see cref="_scheduler"/>.
+    /// </summary>
+    /// <param name="metadataSize">The size of the metadata of the frame in
+    /// bytes.</param>
+    void CollectDirtyRegions(const uint32 metadataSize) noexcept;
+
+    /// <summary>
+    /// Updates the YUV planes from the mapped staging texture.
+    /// </summary>
+    /// <param name="src">The mapped staging texture.</param>
+    /// <param name="pitch">The row pitch of the staging texture in bytes.
+    /// </param>
+    /// <param name="format">The requested format, which releases the planes
+    /// if it is <see cref="EDesktopYuvFormat::None"/>.</param>
+    /// <param name="fullRange"></param>
+    /// <param name="regions">The regions that have changed.</param>
+    void ConvertYuv(const uint8 *src,
+        const uint32 pitch,
+        const EDesktopYuvFormat format,
+        const bool fullRange,
+        const TArray<FIntRect>& regions) noexcept;
+
     /// <summary>
     /// Creates a new Direct3D 11 device.
     /// </summary>
@@ -103,11 +380,28 @@ private:
     static ID3D11Device *CreateDevice(void) noexcept;
 
     /// <summary>
-    /// Searches the DXGI output for the specified display name.
+    /// Answer the size of the desktop shown by the given duplicated texture,
+    /// which has the width and height swapped if the output is rotated by a
+    /// quarter turn.
     /// </summary>
-    /// <param name="name"></param>
+    /// <param name="texture"></param>
     /// <returns></returns>
-    static IDXGIOutput1 *GetOutputForDisplayName(const FString& name) noexcept;
+    FIntPoint GetDesktopSize(ID3D11Texture2D *texture) const noexcept;
+
+    /// <summary>
+    /// Searches the DXGI outputs for the specified display names in a single
+    /// pass over all adapters.
+    /// </summary>
+    /// <remarks>
+    /// This method can be called from any thread.
+    /// </remarks>
+    /// <param name="names"></param>
+    /// <returns>The outputs in the order of the <paramref name="names" />,
+    /// which are <see langword="nullptr" /> for names that have not been
+    /// found. The caller must release all non-<see langword="nullptr" />
+    /// outputs.</returns>
+    static TArray<IDXGIOutput1 *> GetOutputsForDisplayNames(
+        const TArrayView<const FString> names) noexcept;
 
     /// <summary>
     /// Answer whether the given <paramref name="texture" /> has the given size.
@@ -123,6 +417,20 @@ private:
             && (target->GetSurfaceHeight() == height);
     }
 
+    /// <summary>
+    /// Answer whether the desktop is uploaded at half its resolution.
+    /// </summary>
+    /// <returns></returns>
+    bool IsHalfResolution(void) const noexcept;
+
+    /// <summary>
+    /// Makes sure that <see cref="CompressedTarget"/> exists and matches the
+    /// size of the given texture and the <see cref="Compression"/>.
+    /// </summary>
+    /// <param name="texture"></param>
+    /// <returns></returns>
+    bool MatchCompressedTarget(ID3D11Texture2D *texture) noexcept;
+
     /// <summary>
     /// Makes sure that the <see cref="_stagingTexture"/> and the
     /// <see cref="_stagingProjection"/> match the size of the given texture.
@@ -132,27 +440,137 @@ private:
     bool MatchStaging(ID3D11Texture2D *texture) noexcept;
 
     /// <summary>
-    /// Makes sure that <see cref="Target"/> matches the size of the given
-    /// texture.
+    /// Makes sure that <see cref="Target"/> matches the size of the desktop
+    /// in the given texture.
     /// </summary>
     /// <param name="texture"></param>
+    /// <param name="half">Indicates whether the target should have half the
+    /// size of the texture.</param>
     /// <returns></returns>
-    bool MatchTarget(ID3D11Texture2D *texture) noexcept;
+    bool MatchTarget(ID3D11Texture2D *texture, const bool half) noexcept;
+
+    /// <summary>
+    /// Applies changes of the compression and the YUV format and makes sure
+    /// that the target for the current <see cref="Compression"/> and load
+    /// level matches the desktop in the given texture.
+    /// </summary>
+    /// <remarks>
+    /// Any change invalidates the scheduler, because the tiles have been
+    /// cleaned for the previous target.
+    /// </remarks>
+    /// <param name="texture"></param>
+    /// <returns><c>true</c> if the target already matched, <c>false</c> if
+    /// it needed to be re-created.</returns>
+    bool MatchTargets(ID3D11Texture2D *texture) noexcept;
+
+    /// <summary>
+    /// Creates a device and the duplication of the given output.
+    /// </summary>
+    /// <remarks>
+    /// This method does not touch any duplicator and can therefore be called
+    /// from any thread.
+    /// </remarks>
+    /// <param name="session">Receives the objects created, which must be
+    /// released if the method fails.</param>
+    /// <param name="output"></param>
+    /// <param name="name">The display name used for logging.</param>
+    /// <returns><see langword="true" /> if the output is being duplicated.
+    /// </returns>
+    static bool Open(FDesktopDuplicationSession& session,
+        IDXGIOutput1 *output,
+        const FString& name) noexcept;
+
+    /// <summary>
+    /// Rotates the given regions of the mapped staging texture into
+    /// <see cref="_rotated"/> if the output is rotated.
+    /// </summary>
+    /// <param name="src">The mapped staging texture.</param>
+    /// <param name="pitch">The row pitch of <paramref name="src" /> in bytes,
+    /// which receives the row pitch of the returned image.</param>
+    /// <param name="regions">The regions on the rotated desktop.</param>
+    /// <returns>The desktop in its rotated orientation, which is
+    /// <paramref name="src" /> itself if the output is not rotated.</returns>
+    const uint8 *Rotate(const uint8 *src,
+        uint32& pitch,
+        const TArray<FIntRect>& regions) noexcept;
 
     /// <summary>
     /// Stages the given resource for copying to the <see cref="Target"/> and
     /// releases the resource.
     /// </summary>
     /// <param name="resource"></param>
-    /// <returns><see langword="true" /> if the resource has been staged. If
-    /// <see langword="false" /> is returned, it has been dropped.</returns>
+    /// <returns><see langword="true" /> if the resource has been staged and
+    /// an update of the target has been enqueued. If
+    /// <see langword="false" /> is returned, it has been dropped or there was
+    /// nothing to update.</returns>
     bool Stage(IDXGIResource *resource) noexcept;
 
+    /// <summary>
+    /// Uploads the regions of the staging texture that are due according to
+    /// the <see cref="_scheduler"/> to the <see cref="Target"/>.
+    /// </summary>
+    /// <remarks>
+    /// The method must be called while the duplicator is busy and it clears
+    /// the busy flag once it is done.
+    /// </remarks>
+    /// <returns><see langword="true" /> if an update of the target has been
+    /// enqueued, <see langword="false" /> if nothing was due.</returns>
+    bool Submit(void) noexcept;
+
+    /// <summary>
+    /// Releases the staging resources if the desktop has not changed for
+    /// <see cref="IdleTimeout"/> and no deferred region is waiting.
+    /// </summary>
+    /// <remarks>
+    /// The method must be called while the duplicator is busy. The resources
+    /// are re-created by <see cref="Stage"/> once the desktop changes.
+    /// </remarks>
+    /// <returns><see langword="true" /> if the resources have been released
+    /// by this call.</returns>
+    bool TrimIdle(void) noexcept;
+
+    /// <summary>
+    /// Publishes the memory allocated for the buffers used on the render
+    /// thread, which must not be inspected while they are in use.
+    /// </summary>
+    /// <remarks>
+    /// The method must be called by whichever thread owns the busy flag
+    /// after resizing any of the buffers.
+    /// </remarks>
+    void UpdateBufferSize(void) noexcept;
+
+    /// <summary>
+    /// Answer whether the staging texture is shared with the engine's device
+    /// such that frames can be copied on the GPU.
+    /// </summary>
+    /// <returns></returns>
+    bool UseGpuCopy(void) const noexcept;
+
+    TArray<uint8> _blocks;
+    std::atomic<int64> _bufferSize;
     FThreadSafeBool _busy;
+    IDXGIResource *_coalesced;
+    EDesktopBlockCompression _compression;
     ID3D11DeviceContext *_context;
     ID3D11Device *_device;
+    TArray<uint8> _downscaled;
     IDXGIOutputDuplication *_duplication;
+    TArray<FIntRect> _failed;
     ID3D11Fence *_fence;
+    FDesktopDuplicationGovernor _governor;
+    double _lastUpdate;
+    TArray<uint8> _metadata;
+    FIntPoint _pointer;
+    bool _pointerVisible;
+    TArray<FIntRect> _regions;
+    std::atomic<float> _renderTime;
+    TArray<uint8> _rotated;
+    int32 _rotation;
+    FDesktopUpdateScheduler _scheduler;
     IUnknown *_stagingProjection;
     ID3D11Texture2D *_stagingTexture;
+    FDesktopDuplicationStatistics _statistics;
+    FDesktopYuvConverter _yuv;
+    EDesktopYuvFormat _yuvFormat;
+    bool _yuvFullRange;
 };
@@ -0,0 +1,72 @@
+// <copyright file="DesktopDuplicatorStartAction.h" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "Kismet/BlueprintAsyncActionBase.h"
+
+#include "DesktopDuplicator.h"
+
+#include "DesktopDuplicatorStartAction.generated.h"
+
+
+DECLARE_DYNAMIC_MULTICAST_DELEGATE(FDesktopDuplicatorStartDelegate);
+
+
+/// <summary>
+/// Starts one or more <see cref="UDesktopDuplicator"/>s without blocking the
+/// game thread.
+/// </summary>
+UCLASS()
+class UNREALDESKTOPDUPLICATION_API UDesktopDuplicatorStartAction final
+        : public UBlueprintAsyncActionBase {
+    GENERATED_BODY()
+
+public:
+
+    /// <summary>
+    /// Fired if any of the duplicators could not be started.
+    /// </summary>
+    UPROPERTY(BlueprintAssignable)
+    FDesktopDuplicatorStartDelegate Failure;
+
+    /// <summary>
+    /// Fired if all duplicators have been started.
+    /// </summary>
+    UPROPERTY(BlueprintAssignable)
+    FDesktopDuplicatorStartDelegate Success;
+
+    /// <inheritdoc />
+    virtual void Activate(void) override;
+
+    /// <summary>
+    /// Starts all given duplicators in parallel, sharing a single enumeration
+    /// of the outputs.
+    /// </summary>
+    /// <param name="worldContext"></param>
+    /// <param name="duplicators"></param>
+    /// <returns></returns>
+    UFUNCTION(BlueprintCallable, Category = "Desktop duplication", meta = (BlueprintInternalUseOnly = "true", WorldContext = "worldContext"))
+    static UDesktopDuplicatorStartAction *StartAllAsync(UObject *worldContext,
+        const TArray<UDesktopDuplicator *>& duplicators);
+
+    /// <summary>
+    /// Starts the given duplicator on a background thread.
+    /// </summary>
+    /// <param name="worldContext"></param>
+    /// <param name="duplicator"></param>
+    /// <returns></returns>
+    UFUNCTION(BlueprintCallable, Category = "Desktop duplication", meta = (BlueprintInternalUseOnly = "true", WorldContext = "worldContext"))
+    static UDesktopDuplicatorStartAction *StartAsync(UObject *worldContext,
+        UDesktopDuplicator *duplicator);
+
+private:
+
+    UPROPERTY()
+    TArray<UDesktopDuplicator *> _duplicators;
+};
@@ -0,0 +1,144 @@
+// <copyright file="DesktopUpdateScheduler.h" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+
+/// <summary>
+/// Decides which dirty parts of the desktop are uploaded in a frame.
+/// </summary>
+/// <remarks>
+/// <para>The scheduler divides the desktop into square tiles and tracks for
+/// each tile for how many frames it has been dirty. Tiles close to one of
+/// the focus points are uploaded immediately whereas all other tiles are
+/// deferred and uploaded in batches every
+/// <see cref="GetPeripheralInterval"/> frames. No tile is deferred for
+/// <see cref="GetMaxLatency"/> frames or more.</para>
+/// <para>The scheduler does not depend on any graphics API and can therefore
+/// be driven by synthetic dirty regions.</para>
+/// </remarks>
+class UNREALDESKTOPDUPLICATION_API FDesktopUpdateScheduler final {
+
+public:
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    /// <param name="tileSize">The edge length of a tile in pixels.</param>
+    FDesktopUpdateScheduler(const int32 tileSize = 64) noexcept;
+
+    /// <summary>
+    /// Answer the number of frames after which a dirty tile is uploaded at
+    /// the latest.
+    /// </summary>
+    /// <returns></returns>
+    inline int32 GetMaxLatency(void) const noexcept {
+        return this->_maxLatency;
+    }
+
+    /// <summary>
+    /// Answer the interval in frames at which tiles outside the focus are
+    /// uploaded.
+    /// </summary>
+    /// <returns></returns>
+    inline int32 GetPeripheralInterval(void) const noexcept {
+        return this->_peripheralInterval;
+    }
+
+    /// <summary>
+    /// Answer the size of the desktop in pixels.
+    /// </summary>
+    /// <returns></returns>
+    inline FIntPoint GetSize(void) const noexcept {
+        return FIntPoint(this->_width, this->_height);
+    }
+
+    /// <summary>
+    /// Answer whether any dirty tile is waiting for being uploaded.
+    /// </summary>
+    /// <returns></returns>
+    bool HasPending(void) const noexcept;
+
+    /// <summary>
+    /// Marks the whole desktop as dirty such that it is uploaded in the next
+    /// frame regardless of the focus.
+    /// </summary>
+    void Invalidate(void) noexcept;
+
+    /// <summary>
+    /// Marks the given region as dirty.
+    /// </summary>
+    /// <param name="region">The region in pixels. Parts outside the desktop
+    /// are ignored.</param>
+    void MarkDirty(const FIntRect& region) noexcept;
+
+    /// <summary>
+    /// Changes the size of the desktop.
+    /// </summary>
+    /// <remarks>
+    /// If the size actually changes, all tiles are
+    /// <see cref="Invalidate"/>d.
+    /// </remarks>
+    /// <param name="width"></param>
+    /// <param name="height"></param>
+    void Resize(const int32 width, const int32 height) noexcept;
+
+    /// <summary>
+    /// Computes the regions that must be uploaded in the current frame and
+    /// marks them as clean.
+    /// </summary>
+    /// <param name="regions">Receives the regions to be uploaded. Adjacent
+    /// tiles are coalesced into larger rectangles.</param>
+    /// <param name="granularity">The number of tiles in each direction that
+    /// are uploaded as a whole if any of them is due.</param>
+    void Schedule(TArray<FIntRect>& regions,
+        const int32 granularity = 1) noexcept;
+
+    /// <summary>
+    /// Sets the points around which dirty tiles are uploaded immediately.
+    /// </summary>
+    /// <param name="points">The focus points in pixels.</param>
+    /// <param name="radius">The radius around the focus points in pixels.
+    /// </param>
+    void SetFocus(const TArrayView<const FIntPoint> points,
+        const int32 radius) noexcept;
+
+    /// <summary>
+    /// Configures the deferral of tiles outside the focus.
+    /// </summary>
+    /// <param name="peripheralInterval">The interval in frames at which tiles
+    /// outside the focus are uploaded. A value of one disables the
+    /// deferral.</param>
+    /// <param name="maxLatency">The number of frames after which a dirty tile
+    /// is uploaded at the latest.</param>
+    void SetPeriphery(const int32 peripheralInterval,
+        const int32 maxLatency) noexcept;
+
+private:
+
+    /// <summary>
+    /// Answer whether the tile at the given position is close enough to a
+    /// focus point to be uploaded immediately.
+    /// </summary>
+    /// <param name="x"></param>
+    /// <param name="y"></param>
+    /// <returns></returns>
+    bool IsInFocus(const int32 x, const int32 y) const noexcept;
+
+    TArray<uint8> _ages;
+    int32 _columns;
+    TArray<FIntPoint> _focus;
+    uint32 _frame;
+    int32 _height;
+    int32 _maxLatency;
+    int32 _peripheralInterval;
+    int32 _radius;
+    int32 _rows;
+    int32 _tileSize;
+    int32 _width;
+};
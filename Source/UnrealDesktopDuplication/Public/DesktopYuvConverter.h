@@ -0,0 +1,169 @@
+// <copyright file="DesktopYuvConverter.h" company="Visualisierungsinstitut der Universitt Stuttgart">
+// Copyright  2025 Visualisierungsinstitut der Universitt Stuttgart.
+// Licensed under the MIT licence. See LICENCE file for details.
+// </copyright>
+// <author>Christoph Mller</author>
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+#include "HAL/CriticalSection.h"
+
+#include "DesktopYuvConverter.generated.h"
+
+
+/// <summary>
+/// Identifies the planar YUV layout the duplicated desktop is converted to.
+/// </summary>
+UENUM(BlueprintType)
+enum class EDesktopYuvFormat : uint8 {
+    /// <summary>
+    /// No conversion is performed.
+    /// </summary>
+    None,
+
+    /// <summary>
+    /// A luma plane followed by a plane of interleaved Cb and Cr samples with
+    /// 4:2:0 subsampling.
+    /// </summary>
+    NV12,
+
+    /// <summary>
+    /// A luma plane followed by separate Cb and Cr planes with 4:2:0
+    /// subsampling.
+    /// </summary>
+    I420
+};
+
+
+/// <summary>
+/// Describes the planes of a converted frame.
+/// </summary>
+/// <remarks>
+/// The pointers refer to the memory of the
+/// <see cref="FDesktopYuvConverter"/> and are only valid while it is being
+/// read.
+/// </remarks>
+struct FDesktopYuvFrame final {
+
+    /// <summary>
+    /// The layout of the planes.
+    /// </summary>
+    EDesktopYuvFormat Format;
+
+    /// <summary>
+    /// Indicates whether the samples use the full range of [0, 255] rather
+    /// than the limited range of [16, 235] for luma and [16, 240] for chroma.
+    /// </summary>
+    bool FullRange;
+
+    /// <summary>
+    /// The height of the luma plane in pixels.
+    /// </summary>
+    uint32 Height;
+
+    /// <summary>
+    /// The number of valid entries in <see cref="Planes"/> and
+    /// <see cref="Pitches"/>, which is two for NV12 and three for I420.
+    /// </summary>
+    uint32 PlaneCount;
+
+    /// <summary>
+    /// The row pitches of the planes in bytes.
+    /// </summary>
+    uint32 Pitches[3];
+
+    /// <summary>
+    /// The planes in the order Y, Cb(Cr) and Cr.
+    /// </summary>
+    const uint8 *Planes[3];
+
+    /// <summary>
+    /// A counter that is incremented whenever the content of the planes
+    /// changes.
+    /// </summary>
+    uint64 Sequence;
+
+    /// <summary>
+    /// The width of the luma plane in pixels.
+    /// </summary>
+    uint32 Width;
+};
+
+
+/// <summary>
+/// Maintains the NV12 or I420 copy of a duplicated desktop.
+/// </summary>
+/// <remarks>
+/// The planes are retained between frames and only the macroblocks touched
+/// by a changed region are converted again. All methods are thread-safe.
+/// </remarks>
+class UNREALDESKTOPDUPLICATION_API FDesktopYuvConverter final {
+
+public:
+
+    /// <summary>
+    /// The edge length of a macroblock, which is the granularity of updates.
+    /// </summary>
+    static constexpr int32 MacroblockSize = 16;
+
+    /// <summary>
+    /// Initialises a new instance.
+    /// </summary>
+    FDesktopYuvConverter(void) noexcept;
+
+    /// <summary>
+    /// Prepares the planes for the given size and format.
+    /// </summary>
+    /// <param name="width"></param>
+    /// <param name="height"></param>
+    /// <param name="format"></param>
+    /// <param name="fullRange"></param>
+    /// <returns><see langword="true" /> if the planes have been
+    /// (re-)allocated and must be converted as a whole.</returns>
+    bool Configure(const uint32 width,
+        const uint32 height,
+        const EDesktopYuvFormat format,
+        const bool fullRange) noexcept;
+
+    /// <summary>
+    /// Converts the macroblocks touching the given regions of the BGRA image.
+    /// </summary>
+    /// <param name="src">The source image, which must have the size passed
+    /// to <see cref="Configure"/>.</param>
+    /// <param name="pitch">The row pitch of the source in bytes.</param>
+    /// <param name="regions">The changed regions in pixels.</param>
+    void Convert(const uint8 *src,
+        const uint32 pitch,
+        const TArrayView<const FIntRect> regions) noexcept;
+
+    /// <summary>
+    /// Answer the memory allocated for the planes in bytes.
+    /// </summary>
+    /// <returns></returns>
+    SIZE_T GetAllocatedSize(void) const noexcept;
+
+    /// <summary>
+    /// Provides the given callback with direct access to the planes.
+    /// </summary>
+    /// <remarks>
+    /// The planes are not updated while the callback is running, so it
+    /// should copy or submit the data as fast as possible.
+    /// </remarks>
+    /// <param name="reader"></param>
+    /// <returns><see langword="true" /> if a frame was available and the
+    /// <paramref name="reader" /> has been invoked.</returns>
+    bool Read(TFunctionRef<void(const FDesktopYuvFrame&)> reader) const;
+
+    /// <summary>
+    /// Releases the planes.
+    /// </summary>
+    void Release(void) noexcept;
+
+private:
+
+    TArray<uint8> _data;
+    FDesktopYuvFrame _frame;
+    mutable FCriticalSection _lock;
+};